@@ -0,0 +1,293 @@
+// Lexer and parser timings. Run with no argument for every section, or
+// with a section name (see usage).
+
+#include "core/thompson.h"
+#include "core/subset.h"
+#include "core/derivative.h"
+#include "core/search.h"
+#include "core/incremental.h"
+#include "lexer/tokenizer.h"
+#include "parser/parser.h"
+#include "parser/lalr.h"
+#include "parser/pratt.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Best wall time of `runs` calls, in milliseconds
+static double bestOf(int runs, const std::function<void()> &fn) {
+    double best = 1e300;
+    for(int i = 0; i < runs; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - t0;
+        if(ms.count() < best) best = ms.count();
+    }
+    return best;
+}
+
+static std::string repeat(const std::string &s, size_t n) {
+    std::string out;
+    out.reserve(s.size() * n);
+    for(size_t i = 0; i < n; i++) out += s;
+    return out;
+}
+
+// The built-in token spec's DFA, without the construction trace
+static const std::vector<DFAState> &exprDFA() {
+    static const std::vector<DFAState> dfa = subsetConstruct(buildCombinedNFA());
+    return dfa;
+}
+
+// Maximal munch on 'a' | 'a*b' over a run of 'a's: every scan runs to the
+// end looking for a 'b', so backtracking is quadratic
+static void benchMunch() {
+    FullNFA nfa;
+    nfa.start = nfa.newState();
+    auto insert = [&](NFAFragment f, int tk) {
+        nfa.states[nfa.start].trans.emplace_back(f.start, L_EPS, 0);
+        nfa.acceptToken[f.accept] = tk;
+    };
+    insert(makeAtomic(nfa, L_CHAR, 'a'), TK_ID);
+    insert(concatFrag(nfa, starFrag(nfa, makeAtomic(nfa, L_CHAR, 'a')),
+                      makeAtomic(nfa, L_CHAR, 'b')), TK_NUMBER);
+    auto dfa = subsetConstruct(nfa);
+
+    std::string in(20000, 'a');
+    LexOptions linear;
+    linear.linearTime = true;
+    size_t backtracked = 0, memoized = 0;
+    double slow = bestOf(1, [&] { backtracked = tokenize(dfa, in).size(); });
+    double fast = bestOf(5, [&] { memoized = tokenize(dfa, in, linear).size(); });
+
+    std::printf("munch: 'a' | 'a*b' on %zu 'a's\n", in.size());
+    std::printf("  backtracking  %10.2f ms  %zu tokens\n", slow, backtracked);
+    std::printf("  linearTime    %10.2f ms  %zu tokens\n", fast, memoized);
+}
+
+// (a|b)*a(a|b){n}: the DFA has to remember the last n + 1 characters, so
+// it has 2^(n+1) states
+static FullNFA blowupNFA(int n) {
+    FullNFA nfa;
+    nfa.start = nfa.newState();
+    auto ab = [&]() {
+        return unionFrag(nfa, makeAtomic(nfa, L_CHAR, 'a'), makeAtomic(nfa, L_CHAR, 'b'));
+    };
+    NFAFragment f = concatFrag(nfa, starFrag(nfa, ab()), makeAtomic(nfa, L_CHAR, 'a'));
+    for(int i = 0; i < n; i++) f = concatFrag(nfa, f, ab());
+    nfa.states[nfa.start].trans.emplace_back(f.start, L_EPS, 0);
+    nfa.acceptToken[f.accept] = 1;
+    return nfa;
+}
+
+// Subset construction of a large DFA on 1, 2, 4 and 8 threads, and the
+// memory the serial path holds for its batches
+static void benchParallel() {
+    FullNFA nfa = blowupNFA(12);
+    BudgetReport report;
+    size_t states = 0;
+    double serial = bestOf(3, [&] { states = subsetConstruct(nfa, SubsetBudget(), &report).size(); });
+    
+    std::printf("parallel: (a|b)*a(a|b){12}, %zu DFA states, best of 3, %u cores\n", states,
+                std::thread::hardware_concurrency());
+    std::printf("  subsetConstruct   %8.1f ms\n", serial);
+    for(unsigned threads : {1u, 2u, 4u, 8u}) {
+        double ms = bestOf(3, [&] { subsetConstructParallel(nfa, threads); });
+        std::printf("  %u thread%s         %8.1f ms  %4.2fx\n", threads, threads > 1 ? "s" : " ", ms,
+                    serial / ms);
+    }
+    std::printf("  estimated memory  %8.1f MB, %.1f MB at peak with a pending batch\n",
+                report.bytes / 1e6, report.peakBytes / 1e6);
+}
+
+// Full construction of the built-in token spec both ways
+static void benchDerivative() {
+    size_t derivStates = 0, subsetStates = 0;
+    double deriv = bestOf(200, [&] {
+        RegexPool pool;
+        DerivativeDFA dfa(pool, buildCombinedRegex(pool));
+        derivStates = dfa.materialize().size();
+    });
+    double subset = bestOf(200, [&] {
+        subsetStates = subsetConstruct(buildCombinedNFA()).size();
+    });
+
+    std::printf("derivative: built-in token spec, best of 200\n");
+    std::printf("  derivatives       %8.3f ms  %zu states\n", deriv, derivStates);
+    std::printf("  thompson+subset   %8.3f ms  %zu states\n", subset, subsetStates);
+}
+
+// Productions applied by a full LL(1) parse: one per nonterminal expansion
+static size_t countExpansions(const std::vector<Token> &tokens) {
+    const CompiledGrammar &g = builtinGrammar();
+    ParseSession s(g);
+    s.begin(tokens);
+    size_t n = 0;
+    while(!s.isDone()) {
+        if(!s.stackIds().empty() && !g.isTerminal(s.stackIds().back())) n++;
+        s.step();
+    }
+    return n;
+}
+
+static size_t countReductions(const std::vector<Token> &tokens) {
+    LRSession s;
+    s.begin(tokens);
+    size_t n = 0;
+    while(!s.isDone()) {
+        s.step();
+        if(s.lastReduction() >= 0) n++;
+    }
+    return n;
+}
+
+static NFAFragment literalFrag(FullNFA &nfa, const char *word) {
+    NFAFragment f = makeAtomic(nfa, L_CHAR, word[0]);
+    for(const char *p = word + 1; *p; p++) f = concatFrag(nfa, f, makeAtomic(nfa, L_CHAR, *p));
+    return f;
+}
+
+// The ASCII and the Unicode-identifier spec on ASCII-only input
+static void benchUnicode() {
+    std::string text = repeat("alpha + beta_2 * (gamma - 42) / delta9 + ", 250000);
+    const auto &unicode = builtinLexer().dfa;
+    size_t asciiTokens = 0, unicodeTokens = 0;
+    double ascii = bestOf(5, [&] { asciiTokens = tokenize(exprDFA(), text).size(); });
+    double wide = bestOf(5, [&] { unicodeTokens = tokenize(unicode, text).size(); });
+    
+    std::printf("unicode: %.0f MB of ASCII expressions, best of 5\n", text.size() / 1e6);
+    std::printf("  ASCII spec    %8.1f ms  %6.0f MB/s  %zu states\n", ascii, text.size() / 1e3 / ascii,
+                exprDFA().size());
+    std::printf("  Unicode spec  %8.1f ms  %6.0f MB/s  %zu states%s\n", wide, text.size() / 1e3 / wide,
+                unicode.size(), asciiTokens == unicodeTokens ? "" : "  TOKENS DIFFER");
+}
+
+// Adding and removing one keyword rule on top of the built-in spec and 16
+// other keywords, against determinizing the whole NFA again
+static void benchIncremental() {
+    const char *words[] = {"if", "then", "else", "while", "for", "return", "let", "in",
+                           "fn", "true", "false", "and", "or", "not", "match", "case"};
+    IncrementalDFA inc(buildCombinedNFA());
+    for(int w = 0; w < 16; w++) inc.addRule([&](FullNFA &n) { return literalFrag(n, words[w]); }, 20 + w);
+    
+    const int runs = 50;
+    double add = 0, remove = 0;
+    for(int i = 0; i < runs; i++) {
+        int rule = -1;
+        add += bestOf(1, [&] { rule = inc.addRule([](FullNFA &n) { return literalFrag(n, "yield"); }, 40); });
+        remove += bestOf(1, [&] { inc.removeRule(rule); });
+    }
+    size_t states = 0;
+    double full = bestOf(20, [&] { states = subsetConstruct(inc.nfa()).size(); });
+    
+    std::printf("incremental: built-in spec + 16 keywords (%zu states), mean of %d\n", states, runs);
+    std::printf("  addRule         %8.3f ms\n", add / runs);
+    std::printf("  removeRule      %8.3f ms\n", remove / runs);
+    std::printf("  full rebuild    %8.3f ms  (best of 20)\n", full);
+}
+
+// Unanchored search for a few words in log-like text
+static void benchSearch() {
+    FullNFA nfa;
+    nfa.start = nfa.newState();
+    const char *words[] = {"ERROR", "timeout", "refused"};
+    for(int w = 0; w < 3; w++) {
+        NFAFragment f = makeAtomic(nfa, L_CHAR, words[w][0]);
+        for(const char *p = words[w] + 1; *p; p++) f = concatFrag(nfa, f, makeAtomic(nfa, L_CHAR, *p));
+        nfa.states[nfa.start].trans.emplace_back(f.start, L_EPS, 0);
+        nfa.acceptToken[f.accept] = w + 1;
+    }
+    SearchDFA search = buildSearchDFA(nfa);
+    
+    std::string text;
+    for(int i = 0; text.size() < (64u << 20); i++) {
+        text += "2024-05-01 12:00:00 INFO worker " + std::to_string(i % 977) + " handled request\n";
+        if(i % 50 == 0) text += "2024-05-01 12:00:01 ERROR upstream timeout, connection refused\n";
+    }
+    
+    size_t found = 0;
+    double ms = bestOf(3, [&] { found = findAll(search, text).size(); });
+    std::printf("search: 3 words in %.0f MB of log lines, best of 3\n", text.size() / 1e6);
+    std::printf("  findAll  %8.1f ms  %6.0f MB/s  %zu matches\n", ms, text.size() / 1e3 / ms, found);
+}
+
+// LL(1) against LALR(1) in productions per second
+static void benchLALR() {
+    std::string text = repeat("1 + (a * 2 - b) / c + ", 166666) + "1";
+    auto tokens = tokenize(exprDFA(), text);
+
+    ParseSession ll;
+    LRSession lr;
+    bool llOk = false, lrOk = false;
+    double llMs = bestOf(5, [&] { ll.begin(tokens); llOk = ll.run(); });
+    double lrMs = bestOf(5, [&] { lr.begin(tokens); lrOk = lr.run(); });
+    size_t expansions = countExpansions(tokens);
+    size_t reductions = countReductions(tokens);
+
+    std::printf("lalr: %zu tokens of \"1 + (a * 2 - b) / c ...\", best of 5\n", tokens.size());
+    std::printf("  LL(1)    %8.1f ms  %zu expansions  %5.1fM productions/s%s\n", llMs, expansions,
+                expansions / llMs / 1000, llOk ? "" : "  REJECTED");
+    std::printf("  LALR(1)  %8.1f ms  %zu reductions  %5.1fM productions/s%s\n", lrMs, reductions,
+                reductions / lrMs / 1000, lrOk ? "" : "  REJECTED");
+}
+
+// The three expression engines on flat and deeply nested input
+static void benchPratt() {
+    struct Input {
+        const char *name;
+        std::string text;
+    };
+    std::vector<Input> inputs = {
+        {"flat \"1 + a * 2 - b / c ...\"", repeat("1 + a * 2 - b / c + ", 200000) + "1"},
+        {"nested \"(-(-(-...x)))\"", repeat("(-", 500000) + "x" + repeat(")", 500000)},
+        {"nested \"(a*(a*(...x)))\"", repeat("(a*", 500000) + "x" + repeat(")", 500000)},
+    };
+
+    std::printf("pratt: best of 3 (ms)\n");
+    std::printf("  %-30s %7s %8s %8s %8s\n", "input", "tokens", "LL(1)", "LALR(1)", "Pratt");
+    ParseSession ll;
+    LRSession lr;
+    PrattParser pratt;
+    for(const auto &input : inputs) {
+        auto tokens = tokenize(exprDFA(), input.text);
+        bool ok = true;
+        double llMs = bestOf(3, [&] { ll.begin(tokens); ok &= ll.run(); });
+        double lrMs = bestOf(3, [&] { lr.begin(tokens); ok &= lr.run(); });
+        double prattMs = bestOf(3, [&] { ok &= pratt.parse(tokens); });
+        std::printf("  %-30s %6.1fM %8.1f %8.1f %8.1f%s\n", input.name, tokens.size() / 1e6,
+                    llMs, lrMs, prattMs, ok ? "" : "  REJECTED");
+    }
+}
+
+int main(int argc, char **argv) {
+    struct Section {
+        const char *name;
+        void (*run)();
+    };
+    const Section sections[] = {
+        {"munch", benchMunch},
+        {"derivative", benchDerivative},
+        {"parallel", benchParallel},
+        {"search", benchSearch},
+        {"unicode", benchUnicode},
+        {"incremental", benchIncremental},
+        {"lalr", benchLALR},
+        {"pratt", benchPratt},
+    };
+
+    bool found = false;
+    for(const auto &s : sections) {
+        if(argc > 1 && std::strcmp(argv[1], s.name) != 0) continue;
+        s.run();
+        found = true;
+    }
+    if(!found) {
+        std::fprintf(stderr, "usage: %s [munch|derivative|parallel|search|unicode|incremental|lalr|pratt]\n", argv[0]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,309 @@
+#include "derivative.h"
+#include "subset.h"
+#include "tokens.h"
+#include "thompson.h"
+#include <algorithm>
+#include <queue>
+
+RegexPool::RegexPool() {
+    make(RX_EMPTY, -1, -1, false);
+    make(RX_EPS, -1, -1, true);
+}
+
+int RegexPool::make(RegexKind kind, int a, int b, bool nullable) {
+    auto key = std::make_tuple((int)kind, a, b);
+    auto it = index.find(key);
+    if(it != index.end()) return it->second;
+
+    int id = nodes.size();
+    nodes.push_back({kind, a, b, nullable});
+    index[key] = id;
+    return id;
+}
+
+int RegexPool::any() {
+    CharSet all;
+    all.set();
+    return set(all);
+}
+
+int RegexPool::set(const CharSet &chars) {
+    if(chars.none()) return EMPTY;
+
+    auto it = setIndex.find(chars);
+    int s;
+    if(it != setIndex.end()) {
+        s = it->second;
+    } else {
+        s = sets.size();
+        sets.push_back(chars);
+        setIndex[chars] = s;
+    }
+    return make(RX_SET, s, -1, false);
+}
+
+int RegexPool::chr(char c) {
+    CharSet chars;
+    chars.set((unsigned char)c);
+    return set(chars);
+}
+
+int RegexPool::label(LabelKind kind, char ch, char hi) {
+    CharSet chars;
+    for(char c : allChars()) {
+        if(labelMatches(kind, c, ch, hi)) chars.set((unsigned char)c);
+    }
+    return set(chars);
+}
+
+int RegexPool::codePoints(const std::vector<CodeRange> &ranges) {
+    int r = EMPTY;
+    for(const auto &cr : ranges) {
+        for(const auto &seq : utf8Sequences(cr.lo, cr.hi)) {
+            int s = EPS;
+            for(int i = (int)seq.size() - 1; i >= 0; i--) {
+                s = cat(label(L_RANGE, (char)seq[i].lo, (char)seq[i].hi), s);
+            }
+            r = alt(r, s);
+        }
+    }
+    return r;
+}
+
+int RegexPool::cat(int a, int b) {
+    if(a == EMPTY || b == EMPTY) return EMPTY;
+    if(a == EPS) return b;
+    if(b == EPS) return a;
+
+    // Keep concatenation right-nested: (xy)z = x(yz)
+    if(nodes[a].kind == RX_CAT) {
+        int x = nodes[a].a;
+        return cat(x, cat(nodes[a].b, b));
+    }
+    return make(RX_CAT, a, b, nodes[a].nullable && nodes[b].nullable);
+}
+
+int RegexPool::star(int a) {
+    if(a == EMPTY || a == EPS) return EPS;
+    if(nodes[a].kind == RX_STAR) return a;
+    return make(RX_STAR, a, -1, true);
+}
+
+int RegexPool::complement(int a) {
+    if(nodes[a].kind == RX_NOT) return nodes[a].a;
+    return make(RX_NOT, a, -1, !nodes[a].nullable);
+}
+
+int RegexPool::alt(int a, int b) {
+    return combine(RX_OR, a, b);
+}
+
+int RegexPool::inter(int a, int b) {
+    return combine(RX_AND, a, b);
+}
+
+void RegexPool::flatten(RegexKind kind, int r, std::vector<int> &out) const {
+    while(nodes[r].kind == kind) {
+        flatten(kind, nodes[r].a, out);
+        r = nodes[r].b;
+    }
+    out.push_back(r);
+}
+
+// Similarity-normal form of a | b or a & b: operands flattened, set operands
+// merged into one, identities dropped, then sorted and deduplicated
+int RegexPool::combine(RegexKind kind, int a, int b) {
+    std::vector<int> terms;
+    flatten(kind, a, terms);
+    flatten(kind, b, terms);
+
+    bool isOr = kind == RX_OR;
+    int everything = complement(EMPTY);
+    int unit = isOr ? EMPTY : everything;  // a | 0 = a, a & ~0 = a
+    int zero = isOr ? everything : EMPTY;  // a | ~0 = ~0, a & 0 = 0
+
+    std::vector<int> rest;
+    CharSet chars;
+    bool haveSet = false;
+    for(int t : terms) {
+        if(t == zero) return zero;
+        if(t == unit) continue;
+        if(nodes[t].kind == RX_SET) {
+            const CharSet &c = sets[nodes[t].a];
+            if(!haveSet) chars = c;
+            else if(isOr) chars |= c;
+            else chars &= c;
+            haveSet = true;
+            continue;
+        }
+        rest.push_back(t);
+    }
+    if(haveSet) {
+        int s = set(chars);
+        if(s == zero) return zero;
+        if(s != unit) rest.push_back(s);
+    }
+
+    std::sort(rest.begin(), rest.end());
+    rest.erase(std::unique(rest.begin(), rest.end()), rest.end());
+    if(rest.empty()) return unit;
+
+    int r = rest.back();
+    for(int i = (int)rest.size() - 2; i >= 0; i--) {
+        bool n = isOr ? nodes[rest[i]].nullable || nodes[r].nullable
+                      : nodes[rest[i]].nullable && nodes[r].nullable;
+        r = make(kind, rest[i], r, n);
+    }
+    return r;
+}
+
+int RegexPool::derive(int r, char c) {
+    uint64_t key = (uint64_t)r << 8 | (unsigned char)c;
+    auto it = derived.find(key);
+    if(it != derived.end()) return it->second;
+
+    RegexNode n = nodes[r]; // Copy: building nodes may reallocate
+    int d = EMPTY;
+    switch(n.kind) {
+        case RX_EMPTY:
+        case RX_EPS:
+            d = EMPTY;
+            break;
+        case RX_SET:
+            d = sets[n.a].test((unsigned char)c) ? EPS : EMPTY;
+            break;
+        case RX_CAT: {
+            int first = cat(derive(n.a, c), n.b);
+            d = nodes[n.a].nullable ? alt(first, derive(n.b, c)) : first;
+            break;
+        }
+        case RX_STAR:
+            d = cat(derive(n.a, c), r);
+            break;
+        case RX_OR:
+            d = alt(derive(n.a, c), derive(n.b, c));
+            break;
+        case RX_AND:
+            d = inter(derive(n.a, c), derive(n.b, c));
+            break;
+        case RX_NOT:
+            d = complement(derive(n.a, c));
+            break;
+    }
+
+    derived[key] = d;
+    return d;
+}
+
+DerivativeDFA::DerivativeDFA(RegexPool &p, const std::vector<DerivativeRule> &rules) : pool(p) {
+    std::vector<int> regs;
+    for(const auto &rule : rules) {
+        regs.push_back(rule.regex);
+        tokens.push_back(rule.token);
+    }
+    intern(regs);
+}
+
+int DerivativeDFA::intern(const std::vector<int> &regs) {
+    auto it = ids.find(regs);
+    if(it != ids.end()) return it->second;
+
+    int id = states.size();
+    ids[regs] = id;
+    states.push_back(regs);
+
+    // Lowest token id wins, like bestToken() in the lexer
+    int best = -1;
+    for(size_t i = 0; i < regs.size(); i++) {
+        if(pool.nullable(regs[i]) && (best == -1 || tokens[i] < best)) best = tokens[i];
+    }
+    accepts.push_back(best);
+
+    std::array<int, 256> row;
+    row.fill(UNKNOWN);
+    trans.push_back(row);
+    return id;
+}
+
+int DerivativeDFA::next(int state, char c) {
+    int t = trans[state][(unsigned char)c];
+    if(t != UNKNOWN) return t;
+
+    std::vector<int> regs;
+    bool dead = true;
+    for(int r : states[state]) {
+        int d = pool.derive(r, c);
+        if(d != pool.empty()) dead = false;
+        regs.push_back(d);
+    }
+
+    int to = dead ? DEAD : intern(regs);
+    trans[state][(unsigned char)c] = to;
+    return to;
+}
+
+std::vector<DFAState> DerivativeDFA::materialize() {
+    auto chars = allChars();
+    std::queue<int> q;
+    std::vector<bool> seen(size(), false);
+    q.push(start());
+    seen[start()] = true;
+
+    while(!q.empty()) {
+        int s = q.front();
+        q.pop();
+        for(char c : chars) {
+            int to = next(s, c);
+            if(to == DEAD) continue;
+            if(to >= (int)seen.size()) seen.resize(size(), false);
+            if(!seen[to]) {
+                seen[to] = true;
+                q.push(to);
+            }
+        }
+    }
+
+    std::vector<DFAState> dfa(size());
+    for(int s = 0; s < (int)size(); s++) {
+        dfa[s].id = s;
+        for(char c : chars) {
+            int to = trans[s][(unsigned char)c];
+            if(to >= 0) dfa[s].trans[c] = to;
+        }
+        for(size_t i = 0; i < states[s].size(); i++) {
+            if(pool.nullable(states[s][i])) dfa[s].tokens.push_back(tokens[i]);
+        }
+        dfa[s].accept = !dfa[s].tokens.empty();
+    }
+    return dfa;
+}
+
+std::vector<DerivativeRule> buildCombinedRegex(RegexPool &pool, bool unicodeIds) {
+    std::vector<DerivativeRule> rules;
+
+    // ID: letter (alnum|_)*
+    int letter = pool.label(L_LETTER);
+    int alnum = pool.label(L_ALNUM_UNDERSCORE);
+    if(unicodeIds) {
+        letter = pool.alt(letter, pool.codePoints(nonAscii(XID_START, XID_START_SIZE)));
+        alnum = pool.alt(alnum, pool.codePoints(nonAscii(XID_CONTINUE, XID_CONTINUE_SIZE)));
+    }
+    rules.push_back({pool.cat(letter, pool.star(alnum)), TK_ID});
+
+    // NUMBER: digit+ (. digit+)?
+    int digits = pool.plus(pool.label(L_DIGIT));
+    rules.push_back({pool.cat(digits, pool.opt(pool.cat(pool.chr('.'), digits))), TK_NUMBER});
+
+    // Operators
+    rules.push_back({pool.chr('+'), TK_PLUS});
+    rules.push_back({pool.chr('-'), TK_MINUS});
+    rules.push_back({pool.chr('*'), TK_STAR});
+    rules.push_back({pool.chr('/'), TK_SLASH});
+    rules.push_back({pool.chr('('), TK_LPAREN});
+    rules.push_back({pool.chr(')'), TK_RPAREN});
+
+    // Whitespace: (space | tab)+
+    rules.push_back({pool.plus(pool.alt(pool.chr(' '), pool.chr('\t'))), TK_WS});
+
+    return rules;
+}
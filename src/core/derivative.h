@@ -0,0 +1,123 @@
+#ifndef DERIVATIVE_H
+#define DERIVATIVE_H
+
+#include "nfa.h"
+#include "dfa.h"
+#include "utf8.h"
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// Regular expressions as hash-consed ASTs with Brzozowski derivatives.
+// Every node is built through RegexPool, which normalizes it up to
+// similarity (associativity, commutativity and idempotence of | and &,
+// the identities of the empty language and epsilon, r** = r*, ~~r = r),
+// so equal ids mean similar regexes and derivation terminates with
+// finitely many states. Intersection and complement are ordinary nodes.
+
+using CharSet = std::bitset<256>; // Indexed by unsigned char
+
+enum RegexKind {
+    RX_EMPTY, // The empty language
+    RX_EPS,   // The empty string
+    RX_SET,   // One character out of a set
+    RX_CAT,
+    RX_STAR,
+    RX_OR,
+    RX_AND,
+    RX_NOT
+};
+
+struct RegexNode {
+    RegexKind kind;
+    int a;         // First operand, or the set index for RX_SET
+    int b;         // Second operand of a binary node
+    bool nullable; // Accepts the empty string
+};
+
+class RegexPool {
+public:
+    RegexPool();
+
+    int empty() const { return EMPTY; }
+    int eps() const { return EPS; }
+    int any();
+    int set(const CharSet &chars);
+    int chr(char c);
+    int label(LabelKind kind, char ch = 0, char hi = 0); // Same classes as the NFA labels
+    int codePoints(const std::vector<CodeRange> &ranges); // UTF-8 encoded
+    int cat(int a, int b);
+    int alt(int a, int b);
+    int inter(int a, int b);
+    int complement(int a);
+    int star(int a);
+    int plus(int a) { return cat(a, star(a)); }
+    int opt(int a) { return alt(a, EPS); }
+
+    // The derivative of `r` by `c`: what is left of r after reading c
+    int derive(int r, char c);
+
+    bool nullable(int r) const { return nodes[r].nullable; }
+    const RegexNode &node(int r) const { return nodes[r]; }
+    const CharSet &chars(int r) const { return sets[nodes[r].a]; }
+    size_t size() const { return nodes.size(); }
+
+private:
+    static constexpr int EMPTY = 0;
+    static constexpr int EPS = 1;
+
+    int make(RegexKind kind, int a, int b, bool nullable);
+    void flatten(RegexKind kind, int r, std::vector<int> &out) const;
+    int combine(RegexKind kind, int a, int b);
+
+    std::vector<RegexNode> nodes;
+    std::map<std::tuple<int, int, int>, int> index;
+    std::vector<CharSet> sets;
+    std::unordered_map<CharSet, int> setIndex;
+    std::unordered_map<uint64_t, int> derived; // (r << 8 | c) -> derivative
+};
+
+struct DerivativeRule {
+    int regex;
+    int token;
+};
+
+// DFA whose states are vectors of rule derivatives, one per rule. States
+// and transitions are only built when first taken, so a scan touches just
+// the part of the automaton its input needs.
+class DerivativeDFA {
+public:
+    static constexpr int DEAD = -1;
+
+    DerivativeDFA(RegexPool &pool, const std::vector<DerivativeRule> &rules);
+
+    int start() const { return 0; }
+    int next(int state, char c); // DEAD if no token can match any more
+    int token(int state) const { return accepts[state]; } // Best token accepted, or -1
+    size_t size() const { return states.size(); }
+
+    // Build every reachable state over allChars() as a DFAState table, for
+    // tokenize() and the DFA views
+    std::vector<DFAState> materialize();
+
+private:
+    static constexpr int UNKNOWN = -2;
+
+    int intern(const std::vector<int> &regs);
+
+    RegexPool &pool;
+    std::vector<int> tokens;                 // Token of each rule
+    std::vector<std::vector<int>> states;    // Rule derivatives of each state
+    std::map<std::vector<int>, int> ids;
+    std::vector<int> accepts;
+    std::vector<std::array<int, 256>> trans; // UNKNOWN until first taken
+};
+
+// The same token spec as buildCombinedNFA(), as regexes
+std::vector<DerivativeRule> buildCombinedRegex(RegexPool &pool, bool unicodeIds = false);
+
+#endif // DERIVATIVE_H
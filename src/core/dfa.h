@@ -5,12 +5,27 @@
 #include <vector>
 #include <set>
 
+// Counter-extended DFA: a state inside a counted loop x{min,max}. The lexer
+// tracks the iteration count and swaps in the matching variant state.
+struct DFACounter {
+    int id = -1;       // FullNFA::counters index, -1 if no counted loop is active
+    int min = 0;
+    int max = 0;
+    int belowMin = -1; // Variant used while count < min (the loop cannot exit yet)
+    int atMax = -1;    // Variant used once count == max (no further iteration)
+};
+
 struct DFAState { 
     int id = 0; 
     std::unordered_map<char, int> trans; 
     bool accept = false; 
     std::vector<int> tokens; 
     std::set<int> nfaStates; 
+    // Tagged DFA: tags set to the position after the character when taking
+    // trans[c], and tags set to the token start when scanning starts here
+    std::unordered_map<char, std::vector<int>> tagOps; 
+    std::vector<int> entryTags; 
+    DFACounter counter; 
 };
 
 #endif // DFA_H
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include "incremental.h"
+#include "subset.h"
+
+IncrementalDFA::IncrementalDFA(FullNFA nfa) : n(std::move(nfa)) {
+    if(!n.counters.empty()) return; // Rejected: left without a DFA
+
+    owner = ruleOwners(n);
+    for(const auto &t : n.states[n.start].trans) ruleEntry.push_back(t.to);
+
+    d = subsetConstruct(n);
+    for(const auto &st : d) ids[st.nfaStates] = st.id;
+}
+
+void IncrementalDFA::setAccept(DFAState &st) const {
+    st.accept = false;
+    st.tokens.clear();
+    for(int s : st.nfaStates) {
+        auto it = n.acceptToken.find(s);
+        if(it != n.acceptToken.end()) {
+            st.accept = true;
+            st.tokens.push_back(it->second);
+        }
+    }
+}
+
+// Id of the DFA state for `S`, creating it (and queueing it in `work`) if new
+int IncrementalDFA::stateFor(const std::set<int> &S, std::vector<int> &work) {
+    auto it = ids.find(S);
+    if(it != ids.end()) return it->second;
+
+    int id = d.size();
+    d.push_back(DFAState());
+    d[id].id = id;
+    d[id].nfaStates = S;
+    setAccept(d[id]);
+    ids[S] = id;
+    work.push_back(id);
+    return id;
+}
+
+// Recompute every transition of state `sid` from its NFA set
+void IncrementalDFA::link(int sid, std::vector<int> &work) {
+    d[sid].trans.clear();
+    d[sid].tagOps.clear();
+    std::set<int> S = d[sid].nfaStates;
+
+    for(char c : allChars()) {
+        auto mv = moveVia(n, S, c);
+        if(mv.empty()) continue;
+
+        std::set<int> tags;
+        auto U = epsClosure(n, mv, &tags);
+        int to = stateFor(U, work);
+        d[sid].trans[c] = to;
+        if(!tags.empty()) d[sid].tagOps[c].assign(tags.begin(), tags.end());
+    }
+}
+
+int IncrementalDFA::addRule(const RuleBuilder &build, int token) {
+    if(!valid()) return -1;
+
+    // A counted loop cannot be added; drop the fragment's states again
+    size_t numStates = n.states.size();
+    NFAFragment f = build(n);
+    if(!n.counters.empty()) {
+        n.states.resize(numStates);
+        n.counters.clear();
+        return -1;
+    }
+
+    int rule = ruleEntry.size();
+    n.states[n.start].trans.emplace_back(f.start, L_EPS, 0);
+    n.acceptToken[f.accept] = token;
+    owner.resize(n.states.size(), rule);
+    ruleEntry.push_back(f.start);
+
+    // The new rule joins the start state; every other state that gains
+    // some of its NFA states is new and is reached from there
+    std::set<int> entryTags(d[0].entryTags.begin(), d[0].entryTags.end());
+    auto S0 = epsClosure(n, {n.start}, &entryTags);
+    ids.erase(d[0].nfaStates);
+    d[0].nfaStates = S0;
+    d[0].entryTags.assign(entryTags.begin(), entryTags.end());
+    setAccept(d[0]);
+    ids[S0] = 0;
+
+    std::vector<int> work{0};
+    while(!work.empty()) {
+        int sid = work.back();
+        work.pop_back();
+        link(sid, work);
+    }
+
+    // States the start used to lead to may have been superseded
+    compact();
+    return rule;
+}
+
+void IncrementalDFA::removeRule(int rule) {
+    if(!valid() || rule < 0 || rule >= (int)ruleEntry.size()) return;
+    int entry = ruleEntry[rule];
+    if(entry < 0) return;
+    ruleEntry[rule] = -1;
+
+    auto &startTrans = n.states[n.start].trans;
+    for(size_t i = 0; i < startTrans.size(); i++) {
+        if(startTrans[i].to == entry && startTrans[i].kind == L_EPS) {
+            startTrans.erase(startTrans.begin() + i);
+            break;
+        }
+    }
+    for(auto it = n.acceptToken.begin(); it != n.acceptToken.end(); ) {
+        if(owner[it->first] == rule) it = n.acceptToken.erase(it);
+        else ++it;
+    }
+
+    // Project the rule out of every set. Projections can coincide with an
+    // untouched state or with each other; the first state keeps the set.
+    std::vector<int> touched;
+    std::vector<int> remap(d.size());
+    ids.clear();
+    for(auto &st : d) {
+        bool hit = false;
+        for(auto it = st.nfaStates.begin(); it != st.nfaStates.end(); ) {
+            if(owner[*it] == rule) {
+                it = st.nfaStates.erase(it);
+                hit = true;
+            } else {
+                ++it;
+            }
+        }
+
+        if(st.nfaStates.empty()) {
+            remap[st.id] = -1; // Only ever reached through the removed rule
+            continue;
+        }
+        auto it = ids.find(st.nfaStates);
+        if(it != ids.end()) {
+            remap[st.id] = it->second;
+            continue;
+        }
+        ids[st.nfaStates] = st.id;
+        remap[st.id] = st.id;
+        if(hit) touched.push_back(st.id);
+    }
+
+    for(auto &st : d) {
+        if(remap[st.id] != st.id) continue;
+        for(auto it = st.trans.begin(); it != st.trans.end(); ) {
+            it->second = remap[it->second];
+            if(it->second < 0) {
+                st.tagOps.erase(it->first);
+                it = st.trans.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Touched states may have lost tags or accepts with the rule
+    std::vector<int> work;
+    for(int sid : touched) {
+        setAccept(d[sid]);
+        link(sid, work);
+    }
+    while(!work.empty()) {
+        int sid = work.back();
+        work.pop_back();
+        link(sid, work);
+    }
+
+    std::set<int> entryTags;
+    epsClosure(n, {n.start}, &entryTags);
+    d[0].entryTags.assign(entryTags.begin(), entryTags.end());
+
+    compact();
+}
+
+// Drop states no longer reachable from the start and renumber the rest
+void IncrementalDFA::compact() {
+    std::vector<int> newId(d.size(), -1);
+    std::vector<int> order{0};
+    newId[0] = 0;
+    for(size_t i = 0; i < order.size(); i++) {
+        for(const auto &t : d[order[i]].trans) {
+            if(newId[t.second] == -1) {
+                newId[t.second] = order.size();
+                order.push_back(t.second);
+            }
+        }
+    }
+
+    std::vector<DFAState> out;
+    out.reserve(order.size());
+    ids.clear();
+    for(int old : order) {
+        out.push_back(std::move(d[old]));
+        DFAState &st = out.back();
+        st.id = newId[old];
+        for(auto &t : st.trans) t.second = newId[t.second];
+        ids[st.nfaStates] = st.id;
+    }
+    d = std::move(out);
+}
@@ -0,0 +1,52 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "nfa.h"
+#include "dfa.h"
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
+// A token NFA and its DFA kept in sync while rules come and go. Every rule
+// is a fragment hanging off the start state by one epsilon edge, so rules
+// share no NFA states and a DFA state is the union of one part per rule.
+// Adding a rule only determinizes the states that contain some of its NFA
+// states; removing one projects its states out of the sets it touched and
+// re-links only those DFA states. Everything else is reused as is.
+//
+// Counted repetition (countedFrag) is not supported here: an NFA with
+// counters is rejected (valid() is false and the DFA is empty), and so is a
+// rule whose builder adds one.
+class IncrementalDFA {
+public:
+    using RuleBuilder = std::function<NFAFragment(FullNFA &)>;
+
+    // Each epsilon edge out of nfa.start becomes a rule, numbered in order
+    explicit IncrementalDFA(FullNFA nfa);
+
+    bool valid() const { return !d.empty(); }
+
+    // Build a fragment into the NFA and accept it as `token`; returns the
+    // rule id, or -1 if the fragment has a counted loop (the NFA is left as
+    // it was) or the DFA is not valid()
+    int addRule(const RuleBuilder &build, int token);
+    void removeRule(int rule); // No-op unless valid()
+
+    const FullNFA &nfa() const { return n; }
+    const std::vector<DFAState> &dfa() const { return d; }
+
+private:
+    void setAccept(DFAState &st) const;
+    int stateFor(const std::set<int> &S, std::vector<int> &work);
+    void link(int sid, std::vector<int> &work);
+    void compact();
+
+    FullNFA n;
+    std::vector<DFAState> d;
+    std::map<std::set<int>, int> ids;
+    std::vector<int> owner;     // Rule of each NFA state, -1 for the start state
+    std::vector<int> ruleEntry; // Fragment start of each rule, -1 once removed
+};
+
+#endif // INCREMENTAL_H
@@ -0,0 +1,114 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include "symbols.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Reserved words recognized after the DFA accepts a TK_ID, instead of one
+// NFA branch per word. The table is a minimal perfect hash (hash and
+// displace) built at compile time from the same FNV-1a hash the lexer
+// computes while scanning, so a lookup is one probe and one compare.
+//
+//   static constexpr Keyword words[] = {{"if", TK_IF}, {"then", TK_THEN}};
+//   static constexpr auto table = makeKeywordTable(words);
+//   opts.keywords = table.map();
+
+struct Keyword {
+    const char *name;
+    int token;
+};
+
+struct KeywordSlot {
+    const char *name = nullptr;
+    uint32_t length = 0;
+    int token = -1;
+};
+
+// Second-level hash: spread `h` with the bucket's displacement
+constexpr uint32_t keywordMix(uint32_t h, uint32_t d) {
+    uint32_t x = h ^ (d * 0x9E3779B9u);
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    return x;
+}
+
+// Non-owning view of a KeywordTable, what the lexer consults
+struct KeywordMap {
+    const KeywordSlot *slots = nullptr;
+    const uint32_t *displace = nullptr;
+    uint32_t size = 0;
+
+    bool empty() const { return size == 0; }
+
+    // Token id of the keyword `s`, or -1; `h` is SymbolTable::hash(s, len)
+    int lookup(const char *s, size_t len, uint32_t h) const {
+        const KeywordSlot &k = slots[keywordMix(h, displace[h % size]) % size];
+        if(k.length != len || std::memcmp(k.name, s, len) != 0) return -1;
+        return k.token;
+    }
+};
+
+template <size_t N>
+struct KeywordTable {
+    KeywordSlot slots[N] = {};
+    uint32_t displace[N] = {};
+
+    constexpr KeywordMap map() const { return {slots, displace, N}; }
+};
+
+template <size_t N>
+constexpr KeywordTable<N> makeKeywordTable(const Keyword (&words)[N]) {
+    KeywordTable<N> t;
+    uint32_t hashes[N] = {};
+    uint32_t lengths[N] = {};
+    size_t bucketSize[N] = {};
+
+    for(size_t i = 0; i < N; i++) {
+        uint32_t h = SymbolTable::HASH_SEED;
+        uint32_t len = 0;
+        for(const char *p = words[i].name; *p; p++, len++) h = SymbolTable::hashStep(h, *p);
+        hashes[i] = h;
+        lengths[i] = len;
+        bucketSize[h % N]++;
+    }
+
+    bool used[N] = {};
+
+    // Place the most crowded buckets first, searching each one's displacement
+    for(size_t size = N; size > 0; size--) {
+        for(size_t b = 0; b < N; b++) {
+            if(bucketSize[b] != size) continue;
+
+            for(uint32_t d = 1; ; d++) {
+                size_t slot[N] = {};
+                size_t count = 0;
+                bool ok = true;
+                for(size_t i = 0; i < N && ok; i++) {
+                    if(hashes[i] % N != b) continue;
+                    size_t s = keywordMix(hashes[i], d) % N;
+                    if(used[s]) ok = false;
+                    for(size_t j = 0; j < count && ok; j++) {
+                        if(slot[j] == s) ok = false;
+                    }
+                    slot[count++] = s;
+                }
+                if(!ok) continue;
+
+                t.displace[b] = d;
+                for(size_t i = 0, j = 0; i < N; i++) {
+                    if(hashes[i] % N != b) continue;
+                    used[slot[j]] = true;
+                    t.slots[slot[j]] = {words[i].name, lengths[i], words[i].token};
+                    j++;
+                }
+                break;
+            }
+        }
+    }
+    return t;
+}
+
+#endif // KEYWORDS_H
@@ -0,0 +1,34 @@
+#include "modes.h"
+#include "subset.h"
+
+int ModalDFA::modeIndex(const std::string &name) const {
+    for(size_t i = 0; i < names.size(); i++) {
+        if(names[i] == name) return i;
+    }
+    return -1;
+}
+
+ModalDFA buildModalDFA(const std::vector<LexerMode> &modes) {
+    ModalDFA out;
+
+    for(const auto &mode : modes) {
+        // Determinize each mode on its own, then shift its ids into the shared table
+        std::vector<DFAState> dfa = subsetConstruct(mode.nfa);
+        int offset = out.states.size();
+
+        for(auto &st : dfa) {
+            st.id += offset;
+            for(auto &t : st.trans) t.second += offset;
+            // Variants carry the counter but no links of their own (-1)
+            if(st.counter.belowMin >= 0) st.counter.belowMin += offset;
+            if(st.counter.atMax >= 0) st.counter.atMax += offset;
+            out.states.push_back(std::move(st));
+        }
+
+        out.start.push_back(offset);
+        out.names.push_back(mode.name);
+        out.actions.push_back(mode.actions);
+    }
+
+    return out;
+}
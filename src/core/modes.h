@@ -0,0 +1,41 @@
+#ifndef MODES_H
+#define MODES_H
+
+#include "nfa.h"
+#include "dfa.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Start conditions: each lexer mode has its own small token NFA, and tokens
+// can push or pop modes (entering a string literal, a comment, ...).
+enum ModeActionKind {
+    MODE_NONE,
+    MODE_PUSH,
+    MODE_POP
+};
+
+struct ModeAction {
+    ModeActionKind kind = MODE_NONE;
+    int mode = 0; // Target of MODE_PUSH
+};
+
+struct LexerMode {
+    std::string name;
+    FullNFA nfa;
+    std::unordered_map<int, ModeAction> actions; // Token id -> action after it is matched
+};
+
+// Every mode's DFA in one shared state table; mode 0 is the initial mode
+struct ModalDFA {
+    std::vector<DFAState> states;
+    std::vector<int> start; // Start state of each mode
+    std::vector<std::string> names;
+    std::vector<std::unordered_map<int, ModeAction>> actions;
+
+    int modeIndex(const std::string &name) const;
+};
+
+ModalDFA buildModalDFA(const std::vector<LexerMode> &modes);
+
+#endif // MODES_H
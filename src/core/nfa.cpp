@@ -1,8 +1,8 @@
 #include "nfa.h"
 #include <cctype>
 
-NFATrans::NFATrans(int t, LabelKind k, char c) 
-    : to(t), kind(k), ch(c) {}
+NFATrans::NFATrans(int t, LabelKind k, char c, int tg, char h) 
+    : to(t), kind(k), ch(c), tag(tg), hi(h) {}
 
 NFAState::NFAState(int i) : id(i) {}
 
@@ -15,16 +15,26 @@ int FullNFA::newState() {
     return id;
 }
 
-bool labelMatches(LabelKind kind, char c, char expectedChar) {
+static bool isAscii(char c) {
+    return static_cast<unsigned char>(c) < 0x80;
+}
+
+bool labelMatches(LabelKind kind, char c, char expectedChar, char hi) {
     switch(kind) {
         case L_CHAR: 
             return c == expectedChar;
+        // ASCII only: bytes >= 0x80 are UTF-8 sequence bytes, whatever the locale
         case L_DIGIT: 
-            return std::isdigit(static_cast<unsigned char>(c));
+            return isAscii(c) && std::isdigit(static_cast<unsigned char>(c));
         case L_LETTER: 
-            return std::isalpha(static_cast<unsigned char>(c));
+            return isAscii(c) && std::isalpha(static_cast<unsigned char>(c));
         case L_ALNUM_UNDERSCORE: 
-            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+            return isAscii(c) && (std::isalnum(static_cast<unsigned char>(c)) || c == '_');
+        case L_ANY: 
+            return true;
+        case L_RANGE: 
+            return (unsigned char)c >= (unsigned char)expectedChar && 
+                   (unsigned char)c <= (unsigned char)hi;
         default: 
             return false;
     }
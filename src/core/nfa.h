@@ -9,19 +9,24 @@ enum LabelKind {
     L_CHAR, 
     L_DIGIT, 
     L_LETTER, 
-    L_ALNUM_UNDERSCORE 
+    L_ALNUM_UNDERSCORE, 
+    L_ANY, 
+    L_RANGE // Bytes ch..hi
 };
 
 struct NFATrans { 
     int to; 
     LabelKind kind; 
     char ch; 
-    NFATrans(int t = 0, LabelKind k = L_EPS, char c = 0);
+    int tag; // On L_EPS: record the current position in this tag (-1 = none)
+    char hi; // Upper end of an L_RANGE
+    NFATrans(int t = 0, LabelKind k = L_EPS, char c = 0, int tg = -1, char h = 0);
 };
 
 struct NFAState { 
     int id; 
     std::vector<NFATrans> trans; 
+    int counter = -1; // FullNFA::counters index if this is a counted loop state
     NFAState(int i = 0);
 };
 
@@ -30,14 +35,24 @@ struct NFAFragment {
     NFAFragment(int s = 0, int a = 0);
 };
 
+// Bounded repetition x{min,max} of a single character class, kept as one
+// loop state plus a counter instead of max copies of x
+struct NFACounter {
+    int entry; 
+    int loop; 
+    int min; 
+    int max; 
+};
+
 struct FullNFA { 
     std::vector<NFAState> states; 
     int start = -1; 
     std::unordered_map<int, int> acceptToken;
+    std::vector<NFACounter> counters;
     
     int newState();
 };
 
-bool labelMatches(LabelKind kind, char c, char expectedChar = 0);
+bool labelMatches(LabelKind kind, char c, char expectedChar = 0, char hi = 0);
 
 #endif // NFA_H
\ No newline at end of file
@@ -0,0 +1,36 @@
+#include "search.h"
+#include "subset.h"
+
+FullNFA reverseNFA(const FullNFA &nfa, bool unanchored) {
+    FullNFA rev;
+    for(int i = 0; i < (int)nfa.states.size(); i++) rev.newState();
+
+    for(const auto &st : nfa.states) {
+        for(const auto &t : st.trans) {
+            rev.states[t.to].trans.emplace_back(st.id, t.kind, t.ch, -1, t.hi);
+        }
+    }
+
+    rev.start = rev.newState();
+    if(unanchored) rev.states[rev.start].trans.emplace_back(rev.start, L_ANY, 0);
+    for(const auto &acc : nfa.acceptToken) {
+        rev.states[rev.start].trans.emplace_back(acc.first, L_EPS, 0);
+    }
+
+    // Reaching the original start means a whole match has been read backwards
+    rev.acceptToken[nfa.start] = 1;
+    return rev;
+}
+
+SearchDFA buildSearchDFA(const FullNFA &nfa) {
+    SearchDFA out;
+    out.forward = subsetConstruct(nfa);
+    out.reverse = subsetConstruct(reverseNFA(nfa, true));
+
+    // Idle reverse state 0 only leaves itself on a byte some match ends with
+    for(int c = 0; c < 256; c++) out.lastByte[c] = false;
+    for(const auto &t : out.reverse[0].trans) {
+        if(t.second != 0) out.lastByte[(unsigned char)t.first] = true;
+    }
+    return out;
+}
@@ -0,0 +1,22 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "nfa.h"
+#include "dfa.h"
+#include <vector>
+
+// Automata for finding token occurrences anywhere in a text (grep-style)
+// rather than tokenizing it from the first character.
+struct SearchDFA {
+    std::vector<DFAState> forward;  // Anchored token DFA: longest match from a start
+    std::vector<DFAState> reverse;  // .* rev(tokens): marks every offset a match starts at
+    bool lastByte[256];             // Bytes that can end a match (reverse prefilter)
+};
+
+// Reverse every transition of `nfa`; the new start reaches each accept state
+// by epsilon and, if `unanchored`, loops on any character first.
+FullNFA reverseNFA(const FullNFA &nfa, bool unanchored);
+
+SearchDFA buildSearchDFA(const FullNFA &nfa);
+
+#endif // SEARCH_H
@@ -2,16 +2,26 @@
 #include <queue>
 #include <map>
 #include <algorithm>
+#include <tuple>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <iostream> // DEBUG
 
-std::set<int> epsClosure(const FullNFA &nfa, const std::set<int> &in) {
+std::set<int> epsClosure(const FullNFA &nfa, const std::set<int> &in, std::set<int> *tags,
+                         int blocked) {
     std::set<int> res = in;
     std::vector<int> st(in.begin(), in.end());
     
     while(!st.empty()) {
         int s = st.back();
         st.pop_back();
+        if(s == blocked) continue;
         for(auto &t : nfa.states[s].trans) {
+            if(t.kind == L_EPS && t.tag >= 0 && tags) tags->insert(t.tag);
             if(t.kind == L_EPS && !res.count(t.to)) {
                 res.insert(t.to);
                 st.push_back(t.to);
@@ -25,7 +35,7 @@ std::set<int> moveVia(const FullNFA &nfa, const std::set<int> &S, char c) {
     std::set<int> res;
     for(int s : S) {
         for(auto &t : nfa.states[s].trans) {
-            if(labelMatches(t.kind, c, t.ch)) {
+            if(labelMatches(t.kind, c, t.ch, t.hi)) {
                 res.insert(t.to);
             }
         }
@@ -35,108 +45,494 @@ std::set<int> moveVia(const FullNFA &nfa, const std::set<int> &S, char c) {
 
 std::vector<char> allChars() {
     std::vector<char> v;
-    for(int i = 0; i < 128; i++) {
+    for(int i = 0; i < 256; i++) {
         v.push_back((char)i);
     }
     return v;
 }
 
-std::vector<DFAState> subsetConstruct(const FullNFA &nfa) {
+// Identity of a DFA state. For states inside a counted loop it also holds
+// the set with the loop's exit blocked (what the state means while the
+// count is below min) and whether the loop itself is exhausted (count == max).
+struct SubsetKey {
+    std::set<int> states;
+    std::set<int> blocked;
+    bool atMax = false;
+    
+    bool operator<(const SubsetKey &o) const {
+        return std::tie(states, blocked, atMax) < std::tie(o.states, o.blocked, o.atMax);
+    }
+};
+
+// Rough heap cost of one std::set<int> element and one transition entry,
+// for the memory budget
+static const size_t SET_NODE_BYTES = 40;
+static const size_t TRANS_BYTES = 32;
+
+// Counted loop whose loop state is in `S`, or -1. If `other` is given it
+// receives a second counted loop active in `S`, or -1.
+static int counterIn(const FullNFA &nfa, const std::set<int> &S, int *other = nullptr) {
+    if(other) *other = -1;
+    if(nfa.counters.empty()) return -1;
+    int found = -1;
+    for(int s : S) {
+        int ctr = nfa.states[s].counter;
+        if(ctr < 0 || ctr == found) continue;
+        if(found < 0) {
+            found = ctr;
+            if(!other) break;
+        } else {
+            *other = ctr;
+            break;
+        }
+    }
+    return found;
+}
+
+bool checkCounters(const FullNFA &nfa, std::string *error) {
+    for(size_t i = 0; i < nfa.counters.size(); i++) {
+        const NFACounter &ctr = nfa.counters[i];
+        std::string name = "counted loop " + std::to_string(i) + " {" + std::to_string(ctr.min) +
+                           "," + std::to_string(ctr.max) + "}";
+        
+        const char *problem = nullptr;
+        if(ctr.min < 0 || ctr.max < 1) problem = "needs 0 <= min and 1 <= max";
+        else if(ctr.min > ctr.max) problem = "has min > max";
+        
+        // Only the loop state's own edge may repeat the fragment: if its
+        // entry is reachable again from the loop's exit, it sits inside a
+        // star (or some other cycle) and its count would never restart
+        if(!problem) {
+            std::vector<bool> seen(nfa.states.size(), false);
+            std::vector<int> st;
+            for(const auto &t : nfa.states[ctr.loop].trans) {
+                if(t.to != ctr.loop && !seen[t.to]) {
+                    seen[t.to] = true;
+                    st.push_back(t.to);
+                }
+            }
+            while(!st.empty() && !seen[ctr.entry]) {
+                int s = st.back();
+                st.pop_back();
+                for(const auto &t : nfa.states[s].trans) {
+                    if(!seen[t.to]) {
+                        seen[t.to] = true;
+                        st.push_back(t.to);
+                    }
+                }
+            }
+            if(seen[ctr.entry]) problem = "is inside a star or another loop";
+        }
+        
+        if(problem) {
+            if(error) *error = name + " " + problem;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<int> ruleOwners(const FullNFA &nfa) {
+    std::vector<int> owner(nfa.states.size(), -1);
+    int rule = 0;
+    for(const auto &t : nfa.states[nfa.start].trans) {
+        std::vector<int> st{t.to};
+        owner[t.to] = rule;
+        while(!st.empty()) {
+            int s = st.back();
+            st.pop_back();
+            for(const auto &e : nfa.states[s].trans) {
+                if(owner[e.to] == -1 && e.to != nfa.start) {
+                    owner[e.to] = rule;
+                    st.push_back(e.to);
+                }
+            }
+        }
+        rule++;
+    }
+    return owner;
+}
+
+// Which rules the DFA built so far is made of: states per rule, and the
+// pairs of rules that share the most states (their product is what grows)
+static void blameRules(const FullNFA &nfa, const std::vector<DFAState> &dfa, BudgetReport &report) {
+    std::vector<int> owner = ruleOwners(nfa);
+    int numRules = nfa.states[nfa.start].trans.size();
+
+    std::vector<int> token(numRules, -1);
+    for(const auto &acc : nfa.acceptToken) {
+        if(owner[acc.first] >= 0) token[owner[acc.first]] = acc.second;
+    }
+
+    std::vector<int> load(numRules, 0);
+    std::map<std::pair<int, int>, int> shared;
+    for(const auto &st : dfa) {
+        std::set<int> rules;
+        for(int s : st.nfaStates) {
+            if(owner[s] >= 0) rules.insert(owner[s]);
+        }
+        for(int a : rules) {
+            load[a]++;
+            for(int b : rules) {
+                if(a < b) shared[{a, b}]++;
+            }
+        }
+    }
+
+    for(int r = 0; r < numRules; r++) {
+        if(load[r] > 0) report.rules.push_back({r, token[r], load[r]});
+    }
+    std::sort(report.rules.begin(), report.rules.end(),
+              [](const RuleLoad &x, const RuleLoad &y) { return x.states > y.states; });
+
+    for(const auto &p : shared) {
+        report.pairs.push_back({p.first.first, p.first.second, p.second});
+    }
+    std::sort(report.pairs.begin(), report.pairs.end(),
+              [](const RulePair &x, const RulePair &y) { return x.states > y.states; });
+    if(report.pairs.size() > 10) report.pairs.resize(10);
+}
+
+// Threads started once per construction and handed one batch at a time.
+// The calling thread works on each batch too, so `threads` counts it.
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned threads) {
+        for(unsigned t = 1; t < threads; t++) workers.emplace_back([this]() { work(); });
+    }
+    
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            quit = true;
+        }
+        wake.notify_all();
+        for(auto &w : workers) w.join();
+    }
+    
+    // Run fn(0) .. fn(n - 1) and wait for all of them
+    void run(size_t n, const std::function<void(size_t)> &fn) {
+        if(workers.empty() || n < 2) {
+            for(size_t i = 0; i < n; i++) fn(i);
+            return;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(m);
+            job = &fn;
+            count = n;
+            next = 0;
+            busy = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        drain();
+        
+        std::unique_lock<std::mutex> lock(m);
+        idle.wait(lock, [&]() { return busy == 0; });
+        job = nullptr;
+    }
+    
+private:
+    void drain() {
+        for(size_t i = next++; i < count; i = next++) (*job)(i);
+    }
+    
+    void work() {
+        unsigned seen = 0;
+        std::unique_lock<std::mutex> lock(m);
+        while(true) {
+            wake.wait(lock, [&]() { return quit || generation != seen; });
+            if(quit) return;
+            seen = generation;
+            lock.unlock();
+            drain();
+            lock.lock();
+            if(--busy == 0) idle.notify_one();
+        }
+    }
+    
+    std::vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable wake; // A batch was posted, or quit
+    std::condition_variable idle; // The last worker finished its share
+    const std::function<void(size_t)> *job = nullptr;
+    std::atomic<size_t> next{0};
+    size_t count = 0;
+    unsigned generation = 0; // Batches posted so far
+    size_t busy = 0;         // Workers still on the current batch
+    bool quit = false;
+};
+
+// States expanded per batch. Each batch is a prefix of the BFS queue:
+// successors are computed concurrently, then numbered serially in queue
+// and character order, so ids come out exactly as with one thread.
+static const size_t BATCH = 1024;
+
+static std::vector<DFAState> construct(const FullNFA &nfa, const SubsetBudget &budget,
+                                       BudgetReport *report, unsigned threads, bool trace) {
+    // DEBUG trace goes to stdout, or nowhere (a stream without a buffer)
+    std::ostream nowhere(nullptr);
+    std::ostream &log = trace ? std::cout : nowhere;
+    
     std::vector<DFAState> dfa;
-    std::map<std::set<int>, int> id;
-    std::queue<std::set<int>> q;
+    std::map<SubsetKey, int> id;
+    std::queue<SubsetKey> q;
+    
+    auto started = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    size_t pending = 0; // Estimated bytes of the expanded, not yet committed batch
+    size_t peak = 0;
+    
+    // Name of the first budget the construction has run past, or null
+    auto exceeded = [&]() -> const char * {
+        if(budget.maxStates && dfa.size() > budget.maxStates) return "states";
+        if(budget.maxBytes && bytes + pending > budget.maxBytes) return "memory";
+        if(budget.maxSeconds > 0) {
+            std::chrono::duration<double> spent = std::chrono::steady_clock::now() - started;
+            if(spent.count() > budget.maxSeconds) return "time";
+        }
+        return nullptr;
+    };
+    
+    // Refuse an NFA whose counted loops cannot be determinized
+    auto reject = [&](const std::string &why) {
+        log << "\n=== DFA CONSTRUCTION REJECTED: " << why << " ===" << std::endl;
+        if(report) {
+            report->ok = false;
+            report->error = why;
+            report->states = dfa.size();
+            report->bytes = bytes + pending;
+            report->peakBytes = std::max(peak, bytes + pending);
+        }
+        return std::vector<DFAState>();
+    };
+    
+    // A DFA state can only count for one loop at a time
+    auto overlapping = [&](const SubsetKey &k) {
+        int other;
+        int ctr = counterIn(nfa, k.states, &other);
+        if(other < 0) return std::string();
+        return "counted loops " + std::to_string(ctr) + " and " + std::to_string(other) +
+               " are active in the same DFA state";
+    };
     
-    std::set<int> s0 = epsClosure(nfa, {nfa.start});
-    id[s0] = 0;
-    dfa.push_back({0});
-    dfa[0].nfaStates = s0;
+    // Key of the state whose kernel (states entered by the last character) is `mv`
+    auto keyFor = [&](const std::set<int> &mv, std::set<int> *tags) {
+        SubsetKey k;
+        k.states = epsClosure(nfa, mv, tags);
+        int ctr = counterIn(nfa, k.states);
+        if(ctr >= 0) k.blocked = epsClosure(nfa, mv, nullptr, nfa.counters[ctr].loop);
+        return k;
+    };
+    
+    auto addState = [&](const SubsetKey &k) {
+        int nid = dfa.size();
+        id[k] = nid;
+        dfa.push_back(DFAState());
+        dfa[nid].id = nid;
+        dfa[nid].nfaStates = k.states;
+        bytes += sizeof(DFAState) + (k.states.size() * 2 + k.blocked.size()) * SET_NODE_BYTES;
+        
+        int ctr = counterIn(nfa, k.states);
+        if(ctr >= 0) {
+            dfa[nid].counter.id = ctr;
+            dfa[nid].counter.min = nfa.counters[ctr].min;
+            dfa[nid].counter.max = nfa.counters[ctr].max;
+        }
+        
+        // Check if this new state should be accept
+        bool isAccept = false;
+        for(int s : k.states) {
+            if(nfa.acceptToken.count(s)) {
+                dfa[nid].accept = true;
+                dfa[nid].tokens.push_back(nfa.acceptToken.at(s));
+                isAccept = true;
+                log << "  State " << s << " is accept state for token " << nfa.acceptToken.at(s) << std::endl;
+            }
+        }
+        
+        q.push(k);
+        return isAccept;
+    };
+    
+    // Transitions always lead to a counting state's base form; the lexer
+    // switches to a variant from the runtime count
+    auto addVariants = [&](int sid, const SubsetKey &k) {
+        if(dfa[sid].counter.id < 0 || dfa[sid].counter.belowMin >= 0) return;
+        
+        SubsetKey below{k.blocked, k.blocked, false};
+        SubsetKey full{k.states, k.blocked, true};
+        if(!id.count(below)) addState(below);
+        if(!id.count(full)) addState(full);
+        dfa[sid].counter.belowMin = id[below];
+        dfa[sid].counter.atMax = id[full];
+    };
+    
+    std::string why;
+    if(!checkCounters(nfa, &why)) return reject(why);
+    
+    std::set<int> startTags;
+    SubsetKey k0 = keyFor({nfa.start}, &startTags);
+    const std::set<int> &s0 = k0.states;
+    why = overlapping(k0);
+    if(!why.empty()) return reject(why);
     
     // DEBUG: Print start state info
-    std::cout << "=== DFA State 0 (Start) ===" << std::endl;
-    std::cout << "NFA states in closure: ";
+    log << "=== DFA State 0 (Start) ===" << std::endl;
+    log << "NFA states in closure: ";
     for(int s : s0) {
-        std::cout << s << " ";
+        log << s << " ";
     }
-    std::cout << std::endl;
+    log << std::endl;
     
     // Check if start state should be accept
-    bool startIsAccept = false;
-    for(int s : s0) {
-        if(nfa.acceptToken.count(s)) {
-            dfa[0].accept = true;
-            dfa[0].tokens.push_back(nfa.acceptToken.at(s));
-            startIsAccept = true;
-            std::cout << "  State " << s << " is accept state for token " << nfa.acceptToken.at(s) << std::endl;
-        }
-    }
+    bool startIsAccept = addState(k0);
+    dfa[0].entryTags.assign(startTags.begin(), startTags.end());
     
     if(!startIsAccept) {
-        std::cout << "  Start state is NOT an accept state (CORRECT)" << std::endl;
+        log << "  Start state is NOT an accept state (CORRECT)" << std::endl;
     } else {
-        std::cout << "  WARNING: Start state IS an accept state (INCORRECT)" << std::endl;
+        log << "  WARNING: Start state IS an accept state (INCORRECT)" << std::endl;
     }
     
-    q.push(s0);
     auto chars = allChars();
     
-    int stateCount = 1;
-    while(!q.empty()) {
-        auto S = q.front();
-        q.pop();
-        int sid = id[S];
+    // One outgoing transition of a queued state
+    struct Move {
+        char c; 
+        SubsetKey to; 
+        std::set<int> tags; 
+    };
+    
+    // Only reads the NFA, so batches run it on several threads
+    auto expand = [&](const SubsetKey &K, std::vector<Move> &out) {
+        // An exhausted counted loop cannot take another iteration
+        std::set<int> S = K.states;
+        if(K.atMax) S.erase(nfa.counters[counterIn(nfa, K.states)].loop);
         
         for(char c : chars) {
             auto mv = moveVia(nfa, S, c);
             if(mv.empty()) continue;
             
-            auto U = epsClosure(nfa, mv);
-            if(!id.count(U)) {
-                int nid = dfa.size();
-                id[U] = nid;
-                dfa.push_back({nid});
-                dfa[nid].nfaStates = U;
-                
-                // DEBUG: Print new state info
-                std::cout << "\n=== DFA State " << nid << " ===" << std::endl;
-                std::cout << "Created from char: '" << c << "' from state " << sid << std::endl;
-                std::cout << "NFA states: ";
-                for(int s : U) {
-                    std::cout << s << " ";
-                }
-                std::cout << std::endl;
-                
-                // Check if this new state should be accept
-                bool isAccept = false;
-                for(int s : U) {
-                    if(nfa.acceptToken.count(s)) {
-                        dfa[nid].accept = true;
-                        dfa[nid].tokens.push_back(nfa.acceptToken.at(s));
-                        isAccept = true;
-                        std::cout << "  State " << s << " is accept state for token " << nfa.acceptToken.at(s) << std::endl;
+            Move m;
+            m.c = c;
+            m.to = keyFor(mv, &m.tags);
+            out.push_back(std::move(m));
+        }
+    };
+    
+    // Give up with the construction so far as the culprit
+    auto stop = [&](const char *what) {
+        log << "\n=== DFA CONSTRUCTION STOPPED: " << what << " budget exceeded at "
+                  << dfa.size() << " states ===" << std::endl;
+        if(report) {
+            report->ok = false;
+            report->exceeded = what;
+            report->states = dfa.size();
+            report->bytes = bytes + pending;
+            report->peakBytes = std::max(peak, bytes + pending);
+            blameRules(nfa, dfa, *report);
+        }
+        return std::vector<DFAState>();
+    };
+    
+    WorkerPool pool(threads);
+    std::vector<SubsetKey> batch;
+    std::vector<std::vector<Move>> moves;
+    
+    while(!q.empty()) {
+        if(const char *what = exceeded()) return stop(what);
+        
+        // A batch is expanded in full before it is checked again, so take
+        // no more states than the state budget has room for
+        size_t size = BATCH;
+        if(budget.maxStates) {
+            size = std::min(size, std::max<size_t>(1, budget.maxStates - dfa.size()));
+        }
+        
+        batch.clear();
+        while(!q.empty() && batch.size() < size) {
+            batch.push_back(std::move(q.front()));
+            q.pop();
+        }
+        moves.assign(batch.size(), {});
+        pool.run(batch.size(), [&](size_t i) { expand(batch[i], moves[i]); });
+        
+        for(const auto &out : moves) {
+            for(const auto &m : out) {
+                size_t nodes = m.to.states.size() + m.to.blocked.size() + m.tags.size();
+                pending += sizeof(Move) + nodes * SET_NODE_BYTES;
+            }
+        }
+        peak = std::max(peak, bytes + pending);
+        
+        for(size_t i = 0; i < batch.size(); i++) {
+            if(const char *what = exceeded()) return stop(what);
+        
+            int sid = id[batch[i]];
+        
+            for(auto &m : moves[i]) {
+                char c = m.c;
+                const SubsetKey &U = m.to;
+                if(!id.count(U)) {
+                    why = overlapping(U);
+                    if(!why.empty()) return reject(why);
+                    
+                    // DEBUG: Print new state info
+                    log << "\n=== DFA State " << dfa.size() << " ===" << std::endl;
+                    log << "Created from char: '" << c << "' from state " << sid << std::endl;
+                    log << "NFA states: ";
+                    for(int s : U.states) {
+                        log << s << " ";
                     }
-                }
+                    log << std::endl;
                 
-                if(!isAccept) {
-                    std::cout << "  This is NOT an accept state" << std::endl;
+                    if(!addState(U)) {
+                        log << "  This is NOT an accept state" << std::endl;
+                    }
                 }
-                
-                q.push(U);
-                stateCount++;
-            }
             
-            dfa[sid].trans[c] = id[U];
+                int tid = id[U];
+                addVariants(tid, U);
+                dfa[sid].trans[c] = tid;
+                bytes += TRANS_BYTES;
+                if(!m.tags.empty()) dfa[sid].tagOps[c].assign(m.tags.begin(), m.tags.end());
+            }
         }
+        pending = 0;
+    }
+    
+    if(report) {
+        report->ok = true;
+        report->states = dfa.size();
+        report->bytes = bytes;
+        report->peakBytes = std::max(peak, bytes);
     }
     
-    std::cout << "\n=== DFA CONSTRUCTION COMPLETE ===" << std::endl;
-    std::cout << "Total DFA states: " << stateCount << std::endl;
-    std::cout << "Accept states: ";
+    log << "\n=== DFA CONSTRUCTION COMPLETE ===" << std::endl;
+    log << "Total DFA states: " << dfa.size() << std::endl;
+    log << "Accept states: ";
     for(size_t i = 0; i < dfa.size(); i++) {
         if(dfa[i].accept) {
-            std::cout << i << " ";
+            log << i << " ";
         }
     }
-    std::cout << std::endl;
+    log << std::endl;
     
     return dfa;
-}
\ No newline at end of file
+}
+
+std::vector<DFAState> subsetConstruct(const FullNFA &nfa, bool trace) {
+    return construct(nfa, SubsetBudget(), nullptr, 1, trace);
+}
+
+std::vector<DFAState> subsetConstruct(const FullNFA &nfa, const SubsetBudget &budget,
+                                      BudgetReport *report, bool trace) {
+    return construct(nfa, budget, report, 1, trace);
+}
+
+std::vector<DFAState> subsetConstructParallel(const FullNFA &nfa, unsigned threads, bool trace) {
+    if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    return construct(nfa, SubsetBudget(), nullptr, threads, trace);
+}
@@ -3,12 +3,73 @@
 
 #include "nfa.h"
 #include "dfa.h"
+#include <cstddef>
 #include <set>
+#include <string>
 #include <vector>
 
-std::set<int> epsClosure(const FullNFA &nfa, const std::set<int> &in);
+// Limits for subsetConstruct(); 0 means unlimited
+struct SubsetBudget {
+    size_t maxStates = 0;
+    size_t maxBytes = 0;   // Estimated heap use of the states built so far
+    double maxSeconds = 0;
+};
+
+struct RuleLoad {
+    int rule;   // Index of the rule's epsilon edge out of the NFA start
+    int token;
+    int states; // DFA states containing some of its NFA states
+};
+
+struct RulePair {
+    int ruleA;
+    int ruleB;
+    int states; // DFA states containing both
+};
+
+// Outcome of a budgeted construction. When a budget is exceeded, `rules`
+// and `pairs` (heaviest first) point at the rules whose combination blew up.
+// An NFA whose counted loops cannot be determinized fails with `error` set
+// and `exceeded` empty.
+struct BudgetReport {
+    bool ok = true;
+    std::string exceeded; // "states", "memory" or "time"
+    std::string error;
+    size_t states = 0;
+    size_t bytes = 0;
+    size_t peakBytes = 0; // Most `bytes` plus one expanded, uncommitted batch reached
+    std::vector<RuleLoad> rules;
+    std::vector<RulePair> pairs;
+};
+
+// If `tags` is given, every tag on a traversed epsilon edge is added to it.
+// Epsilon edges out of state `blocked` are not followed.
+std::set<int> epsClosure(const FullNFA &nfa, const std::set<int> &in, std::set<int> *tags = nullptr,
+                         int blocked = -1);
 std::set<int> moveVia(const FullNFA &nfa, const std::set<int> &S, char c);
 std::vector<char> allChars();
-std::vector<DFAState> subsetConstruct(const FullNFA &nfa);
+
+// Whether every counted loop has 0 <= min <= max and 1 <= max and does not
+// sit inside a star or another loop; if not, `error` says which one and why.
+// Two loops active in the same DFA state only show up during construction.
+bool checkCounters(const FullNFA &nfa, std::string *error = nullptr);
+
+// `trace` prints every state to stdout as it is built, for the GUI's debug
+// output. Returns an empty DFA if the NFA's counted loops cannot be
+// determinized (see checkCounters()).
+std::vector<DFAState> subsetConstruct(const FullNFA &nfa, bool trace = false);
+
+// Stops as soon as a budget is exceeded and returns an empty DFA
+std::vector<DFAState> subsetConstruct(const FullNFA &nfa, const SubsetBudget &budget,
+                                      BudgetReport *report, bool trace = false);
+
+// Same DFA, state ids included, with each BFS batch expanded on `threads`
+// worker threads (0 = one per core)
+std::vector<DFAState> subsetConstructParallel(const FullNFA &nfa, unsigned threads = 0,
+                                              bool trace = false);
+
+// Rule of each NFA state: the index of the start epsilon edge it hangs off,
+// -1 for the start state itself
+std::vector<int> ruleOwners(const FullNFA &nfa);
 
 #endif // SUBSET_H
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "symbols.h"
+#include <cstring>
+
+uint32_t SymbolTable::hash(const char *s, size_t len) {
+    uint32_t h = HASH_SEED;
+    for(size_t i = 0; i < len; i++) h = hashStep(h, s[i]);
+    return h;
+}
+
+SymbolTable::SymbolTable() {
+    slots.assign(64, -1);
+}
+
+// Slot holding `s`, or the empty slot where it would go (linear probing)
+size_t SymbolTable::slotFor(const char *s, size_t len, uint32_t h) const {
+    size_t mask = slots.size() - 1;
+    for(size_t i = h & mask; ; i = (i + 1) & mask) {
+        int id = slots[i];
+        if(id < 0) return i;
+        if(hashes[id] == h && lengths[id] == len &&
+           std::memcmp(arena.data() + offsets[id], s, len) == 0) {
+            return i;
+        }
+    }
+}
+
+int SymbolTable::find(const char *s, size_t len, uint32_t h) const {
+    return slots[slotFor(s, len, h)];
+}
+
+int SymbolTable::intern(const char *s, size_t len, uint32_t h) {
+    size_t slot = slotFor(s, len, h);
+    if(slots[slot] >= 0) return slots[slot];
+
+    int id = offsets.size();
+    offsets.push_back(arena.size());
+    lengths.push_back(len);
+    hashes.push_back(h);
+    arena.insert(arena.end(), s, s + len);
+    slots[slot] = id;
+
+    // Keep the load factor under one half
+    if(offsets.size() * 2 > slots.size()) grow();
+    return id;
+}
+
+void SymbolTable::grow() {
+    slots.assign(slots.size() * 2, -1);
+    size_t mask = slots.size() - 1;
+    for(size_t id = 0; id < offsets.size(); id++) {
+        size_t i = hashes[id] & mask;
+        while(slots[i] >= 0) i = (i + 1) & mask;
+        slots[i] = id;
+    }
+}
+
+std::string SymbolTable::name(int id) const {
+    return std::string(arena.data() + offsets[id], lengths[id]);
+}
+
+void SymbolTable::clear() {
+    arena.clear();
+    offsets.clear();
+    lengths.clear();
+    hashes.clear();
+    slots.assign(64, -1);
+}
@@ -0,0 +1,43 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Interned identifier names. Names live back to back in one byte arena and
+// are found through an open-addressing hash table, so every distinct name
+// gets a dense id and equality becomes an integer compare. One table can be
+// shared by all expressions of a batch.
+class SymbolTable {
+public:
+    // FNV-1a, folded one character at a time so the lexer can hash while scanning
+    static const uint32_t HASH_SEED = 2166136261u;
+    static constexpr uint32_t hashStep(uint32_t h, char c) {
+        return (h ^ (unsigned char)c) * 16777619u;
+    }
+    static uint32_t hash(const char *s, size_t len);
+
+    SymbolTable();
+
+    int intern(const char *s, size_t len, uint32_t h);
+    int intern(const std::string &s) { return intern(s.data(), s.size(), hash(s.data(), s.size())); }
+    int find(const char *s, size_t len, uint32_t h) const;
+    int find(const std::string &s) const { return find(s.data(), s.size(), hash(s.data(), s.size())); }
+
+    size_t size() const { return offsets.size(); }
+    std::string name(int id) const;
+    void clear();
+
+private:
+    size_t slotFor(const char *s, size_t len, uint32_t h) const;
+    void grow();
+
+    std::vector<char> arena;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<uint32_t> hashes;
+    std::vector<int32_t> slots; // Symbol id or -1; size is a power of two
+};
+
+#endif // SYMBOLS_H
@@ -1,5 +1,7 @@
 #include "thompson.h"
 #include "tokens.h"
+#include <algorithm>
+#include <map>
 
 NFAFragment makeAtomic(FullNFA &nfa, LabelKind kind, char ch) {
     int s = nfa.newState();
@@ -42,6 +44,66 @@ NFAFragment optFrag(FullNFA &nfa, const NFAFragment &f) {
     return {s, a};
 }
 
+// Empty match that records the current position in `tag`
+NFAFragment tagFrag(FullNFA &nfa, int tag) {
+    int s = nfa.newState();
+    int a = nfa.newState();
+    nfa.states[s].trans.emplace_back(a, L_EPS, 0, tag);
+    return {s, a};
+}
+
+NFAFragment countedFrag(FullNFA &nfa, LabelKind kind, char ch, int min, int max) {
+    int s = nfa.newState();
+    int l = nfa.newState();
+    int a = nfa.newState();
+    nfa.states[s].trans.emplace_back(l, kind, ch);
+    nfa.states[l].trans.emplace_back(l, kind, ch);
+    nfa.states[l].trans.emplace_back(a, L_EPS, 0);
+    if(min == 0) nfa.states[s].trans.emplace_back(a, L_EPS, 0);
+    
+    nfa.states[l].counter = nfa.counters.size();
+    nfa.counters.push_back({s, l, min, max});
+    return {s, a};
+}
+
+NFAFragment utf8Frag(FullNFA &nfa, const std::vector<CodeRange> &ranges) {
+    int s = nfa.newState();
+    int a = nfa.newState();
+    
+    // State that reads a given byte-range suffix and then accepts
+    std::map<std::vector<std::pair<int, int>>, int> suffixState;
+    
+    for(const auto &r : ranges) {
+        for(const auto &seq : utf8Sequences(r.lo, r.hi)) {
+            int next = a;
+            std::vector<std::pair<int, int>> suffix;
+            for(int i = (int)seq.size() - 1; i >= 1; i--) {
+                suffix.insert(suffix.begin(), {seq[i].lo, seq[i].hi});
+                auto it = suffixState.find(suffix);
+                if(it != suffixState.end()) {
+                    next = it->second;
+                    continue;
+                }
+                int st = nfa.newState();
+                nfa.states[st].trans.emplace_back(next, L_RANGE, (char)seq[i].lo, -1, (char)seq[i].hi);
+                suffixState[suffix] = st;
+                next = st;
+            }
+            nfa.states[s].trans.emplace_back(next, L_RANGE, (char)seq[0].lo, -1, (char)seq[0].hi);
+        }
+    }
+    return {s, a};
+}
+
+std::vector<CodeRange> nonAscii(const CodeRange *ranges, size_t n) {
+    std::vector<CodeRange> out;
+    for(size_t i = 0; i < n; i++) {
+        if(ranges[i].hi < 0x80) continue;
+        out.push_back({std::max<uint32_t>(ranges[i].lo, 0x80), ranges[i].hi});
+    }
+    return out;
+}
+
 // Helper to create (a|b)+ (one or more)
 NFAFragment plusFrag(FullNFA &nfa, const NFAFragment &f) {
     int s = nfa.newState();
@@ -52,7 +114,7 @@ NFAFragment plusFrag(FullNFA &nfa, const NFAFragment &f) {
     return {s, a};
 }
 
-FullNFA buildCombinedNFA() {
+FullNFA buildCombinedNFA(bool unicodeIds) {
     FullNFA nfa;
     nfa.start = nfa.newState();
     
@@ -64,6 +126,10 @@ FullNFA buildCombinedNFA() {
     // ID: letter (alnum|_)*
     auto letter = makeAtomic(nfa, L_LETTER);
     auto alnum = makeAtomic(nfa, L_ALNUM_UNDERSCORE);
+    if(unicodeIds) {
+        letter = unionFrag(nfa, letter, utf8Frag(nfa, nonAscii(XID_START, XID_START_SIZE)));
+        alnum = unionFrag(nfa, alnum, utf8Frag(nfa, nonAscii(XID_CONTINUE, XID_CONTINUE_SIZE)));
+    }
     insert(concatFrag(nfa, letter, starFrag(nfa, alnum)), TK_ID);
     
     // NUMBER: digit+ (. digit+)?
@@ -75,7 +141,8 @@ FullNFA buildCombinedNFA() {
                         concatFrag(nfa, makeAtomic(nfa, L_DIGIT), 
                                   starFrag(nfa, makeAtomic(nfa, L_DIGIT))));
     auto optFractional = optFrag(nfa, fractional);
-    auto numberFrag = concatFrag(nfa, digitPlus, optFractional);
+    auto intPart = concatFrag(nfa, digitPlus, tagFrag(nfa, TAG_NUMBER_INT_END));
+    auto numberFrag = concatFrag(nfa, intPart, optFractional);
     insert(numberFrag, TK_NUMBER);
     
     // Operators
@@ -2,13 +2,31 @@
 #define THOMPSON_H
 
 #include "nfa.h"
+#include "utf8.h"
+#include <vector>
 
 NFAFragment makeAtomic(FullNFA &nfa, LabelKind kind, char ch = 0);
 NFAFragment concatFrag(FullNFA &nfa, const NFAFragment &a, const NFAFragment &b);
 NFAFragment unionFrag(FullNFA &nfa, const NFAFragment &a, const NFAFragment &b);
 NFAFragment starFrag(FullNFA &nfa, const NFAFragment &f);
 NFAFragment optFrag(FullNFA &nfa, const NFAFragment &f);
+NFAFragment tagFrag(FullNFA &nfa, int tag);
 
-FullNFA buildCombinedNFA();
+// atom{min,max} with 0 <= min <= max and 1 <= max, as a single loop state
+// plus a counter. The fragment must not sit inside a star or another
+// counted loop, and no two counted loops may be active in the same DFA
+// state; subset construction rejects an NFA that breaks any of these.
+NFAFragment countedFrag(FullNFA &nfa, LabelKind kind, char ch, int min, int max);
+
+// Any code point in `ranges`, UTF-8 encoded, as byte-range transitions.
+// Sequences with a common tail share its states.
+NFAFragment utf8Frag(FullNFA &nfa, const std::vector<CodeRange> &ranges);
+
+// The non-ASCII part of a code point class
+std::vector<CodeRange> nonAscii(const CodeRange *ranges, size_t n);
+
+// With `unicodeIds`, ID also takes non-ASCII XID_Start / XID_Continue code
+// points (UTF-8 encoded); the ASCII part of the spec is unchanged
+FullNFA buildCombinedNFA(bool unicodeIds = false);
 
 #endif // THOMPSON_H
\ No newline at end of file
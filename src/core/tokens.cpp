@@ -1,5 +1,5 @@
 #include "tokens.h"
 
-std::vector<std::string> tokenNames = {
-    "", "ID", "NUMBER", "+", "-", "*", "/", "(", ")", "WS"
+const std::vector<std::string> tokenNames = {
+    "", "ID", "NUMBER", "+", "-", "*", "/", "(", ")", "WS", "ERROR"
 };
\ No newline at end of file
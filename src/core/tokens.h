@@ -1,6 +1,7 @@
 #ifndef TOKENS_H
 #define TOKENS_H
 
+#include <array>
 #include <string>
 #include <vector>
 
@@ -13,15 +14,32 @@ enum TokenID {
     TK_SLASH, 
     TK_LPAREN, 
     TK_RPAREN, 
-    TK_WS 
+    TK_WS, 
+    TK_ERROR 
 };
 
-extern std::vector<std::string> tokenNames;
+// Capture positions recorded while a token is scanned
+enum TagID { 
+    TAG_NUMBER_INT_END = 0, // End of a NUMBER's integer part ('.' or token end)
+    TAG_COUNT 
+};
+
+extern const std::vector<std::string> tokenNames;
+
+// Tag positions with every tag unset (-1)
+constexpr std::array<int, TAG_COUNT> unsetTags() {
+    std::array<int, TAG_COUNT> tags{};
+    for(int &t : tags) t = -1;
+    return tags;
+}
 
 struct Token { 
     int id; 
     std::string lexeme; 
     int pos; 
+    int sym = -1; // SymbolTable id of a TK_ID when the lexer interns identifiers
+    std::array<int, TAG_COUNT> tags = unsetTags(); // Absolute positions, -1 if unset
+    int scanEnd = -1; // One past the furthest character the lexer read for it, -1 if unknown
 };
 
 // ADD THIS NEW FILE for the implementation:
@@ -0,0 +1,143 @@
+#include "tokenstream.h"
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t v) {
+    while(v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static uint32_t getVarint(const std::vector<uint8_t> &in, size_t &offset) {
+    uint32_t v = 0;
+    int shift = 0;
+    while(true) {
+        uint8_t b = in[offset++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) return v;
+        shift += 7;
+    }
+}
+
+TokenStream::Cursor::Cursor(const TokenStream &s) : stream(&s) {
+    if(valid()) decode();
+}
+
+void TokenStream::Cursor::next() {
+    index++;
+    if(valid()) decode();
+}
+
+void TokenStream::Cursor::decode() {
+    start = end + getVarint(stream->spans, offset);
+    len = getVarint(stream->spans, offset);
+    symbol = stream->ids[index] == TK_ID ? (int)getVarint(stream->spans, offset) - 1 : -1;
+    end = start + len;
+}
+
+void TokenStream::clear() {
+    ids.clear();
+    spans.clear();
+    checkpointOffset.clear();
+    checkpointEnd.clear();
+    lastEnd = 0;
+}
+
+void TokenStream::reserve(size_t n) {
+    ids.reserve(n);
+    spans.reserve(n * 2);
+    checkpointOffset.reserve(n / CHECKPOINT_EVERY + 1);
+    checkpointEnd.reserve(n / CHECKPOINT_EVERY + 1);
+}
+
+bool TokenStream::push(int id, int pos, int length, int sym) {
+    if(id < 0 || id > MAX_ID) return false;
+    if(ids.size() % CHECKPOINT_EVERY == 0) {
+        checkpointOffset.push_back(spans.size());
+        checkpointEnd.push_back(lastEnd);
+    }
+    ids.push_back((uint16_t)id);
+    putVarint(spans, pos - lastEnd);
+    putVarint(spans, length);
+    if(id == TK_ID) putVarint(spans, sym + 1);
+    lastEnd = pos + length;
+    return true;
+}
+
+bool TokenStream::push(const Token &t) {
+    // The EOF token's "$" is not part of the source text
+    return push(t.id, t.pos, t.id == 0 ? 0 : (int)t.lexeme.size(), t.sym);
+}
+
+void TokenStream::locate(size_t i, int &start, int &len, int &sym) const {
+    size_t cp = i / CHECKPOINT_EVERY;
+    size_t offset = checkpointOffset[cp];
+    int end = checkpointEnd[cp];
+    for(size_t k = cp * CHECKPOINT_EVERY; ; k++) {
+        start = end + getVarint(spans, offset);
+        len = getVarint(spans, offset);
+        sym = ids[k] == TK_ID ? (int)getVarint(spans, offset) - 1 : -1;
+        if(k == i) return;
+        end = start + len;
+    }
+}
+
+int TokenStream::pos(size_t i) const {
+    int start, len, sym;
+    locate(i, start, len, sym);
+    return start;
+}
+
+int TokenStream::length(size_t i) const {
+    int start, len, sym;
+    locate(i, start, len, sym);
+    return len;
+}
+
+int TokenStream::sym(size_t i) const {
+    int start, len, sym;
+    locate(i, start, len, sym);
+    return sym;
+}
+
+void TokenStream::span(size_t i, int &start, int &len) const {
+    int sym;
+    locate(i, start, len, sym);
+}
+
+std::string TokenStream::lexeme(size_t i, const std::string &src) const {
+    if(ids[i] == 0) return "$";
+    int start, len, sym;
+    locate(i, start, len, sym);
+    return src.substr(start, len);
+}
+
+Token TokenStream::at(size_t i, const std::string &src) const {
+    int start, len, symbol;
+    locate(i, start, len, symbol);
+    return {id(i), id(i) == 0 ? "$" : src.substr(start, len), start, symbol};
+}
+
+std::vector<Token> TokenStream::toTokens(const std::string &src) const {
+    std::vector<Token> out;
+    out.reserve(size());
+    for(Cursor c = cursor(); c.valid(); c.next()) {
+        out.push_back({c.id(), c.id() == 0 ? "$" : src.substr(c.pos(), c.length()), c.pos(), c.sym()});
+    }
+    return out;
+}
+
+TokenStream TokenStream::fromTokens(const std::vector<Token> &tokens) {
+    TokenStream s;
+    s.reserve(tokens.size());
+    for(const auto &t : tokens) {
+        if(!s.push(t)) return TokenStream();
+    }
+    return s;
+}
+
+size_t TokenStream::memoryBytes() const {
+    return ids.capacity() * sizeof(uint16_t) + spans.capacity() +
+           checkpointOffset.capacity() * sizeof(uint32_t) +
+           checkpointEnd.capacity() * sizeof(int32_t);
+}
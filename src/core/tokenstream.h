@@ -0,0 +1,80 @@
+#ifndef TOKENSTREAM_H
+#define TOKENSTREAM_H
+
+#include "tokens.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Columnar token stream: a 16-bit token id per token plus a varint byte
+// stream of (gap since previous token end, length) pairs, followed by the
+// symbol id + 1 for TK_ID tokens. Lexemes are not stored; they are sliced
+// from the source text on demand. A checkpoint every CHECKPOINT_EVERY tokens
+// keeps random access to positions cheap. The id column stays fixed-width
+// so parsers can index it directly; keyword ids (KeywordMap) can pass 255.
+class TokenStream {
+public:
+    static const size_t CHECKPOINT_EVERY = 64;
+    static constexpr int MAX_ID = UINT16_MAX; // Largest token id push() takes
+
+    // Sequential decoder, the fast way to walk the whole stream
+    class Cursor {
+    public:
+        explicit Cursor(const TokenStream &s);
+
+        bool valid() const { return index < stream->size(); }
+        void next();
+
+        size_t position() const { return index; }
+        int id() const { return stream->ids[index]; }
+        int pos() const { return start; }
+        int length() const { return len; }
+        int sym() const { return symbol; }
+
+    private:
+        void decode();
+
+        const TokenStream *stream;
+        size_t index = 0;
+        size_t offset = 0;  // Read position in spans
+        int end = 0;        // End of the previous token
+        int start = 0;
+        int len = 0;
+        int symbol = -1;
+    };
+
+    void clear();
+    void reserve(size_t n);
+    // False, and nothing is added, if `id` is outside 0 .. MAX_ID
+    bool push(int id, int pos, int length, int sym = -1);
+    bool push(const Token &t);
+
+    size_t size() const { return ids.size(); }
+    bool empty() const { return ids.empty(); }
+    int id(size_t i) const { return ids[i]; }
+    const std::vector<uint16_t> &idColumn() const { return ids; }
+
+    int pos(size_t i) const;
+    int length(size_t i) const;
+    int sym(size_t i) const;
+    void span(size_t i, int &start, int &len) const;
+    std::string lexeme(size_t i, const std::string &src) const;
+    Token at(size_t i, const std::string &src) const;
+
+    Cursor cursor() const { return Cursor(*this); }
+    std::vector<Token> toTokens(const std::string &src) const;
+    static TokenStream fromTokens(const std::vector<Token> &tokens); // Empty if an id is too wide
+
+    size_t memoryBytes() const;
+
+private:
+    void locate(size_t i, int &start, int &len, int &sym) const;
+
+    std::vector<uint16_t> ids;
+    std::vector<uint8_t> spans;
+    std::vector<uint32_t> checkpointOffset; // spans offset of token k * CHECKPOINT_EVERY
+    std::vector<int32_t> checkpointEnd;     // end of the token before it
+    int lastEnd = 0;
+};
+
+#endif // TOKENSTREAM_H
@@ -0,0 +1,78 @@
+#include "utf8.h"
+
+static int encode(uint32_t cp, unsigned char *out) {
+    if(cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+    if(cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if(cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3F);
+    out[2] = 0x80 | ((cp >> 6) & 0x3F);
+    out[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+// Split the range until both ends encode to the same length and every
+// continuation byte past the first differing one spans 80..BF; then the
+// byte ranges of the two ends, position by position, are exact.
+std::vector<std::vector<ByteRange>> utf8Sequences(uint32_t lo, uint32_t hi) {
+    std::vector<std::vector<ByteRange>> out;
+    std::vector<CodeRange> todo{{lo, hi}};
+
+    while(!todo.empty()) {
+        CodeRange r = todo.back();
+        todo.pop_back();
+        if(r.lo > r.hi) continue;
+
+        if(r.lo <= 0xDFFF && r.hi >= 0xD800) {
+            if(r.hi > 0xDFFF) todo.push_back({0xE000, r.hi});
+            if(r.lo < 0xD800) todo.push_back({r.lo, 0xD7FF});
+            continue;
+        }
+
+        bool split = false;
+        for(uint32_t max : {0x7Fu, 0x7FFu, 0xFFFFu}) {
+            if(r.lo <= max && max < r.hi) {
+                todo.push_back({max + 1, r.hi});
+                todo.push_back({r.lo, max});
+                split = true;
+                break;
+            }
+        }
+        if(split) continue;
+
+        for(int i = 1; i < 4 && !split; i++) {
+            uint32_t m = (1u << (6 * i)) - 1;
+            if((r.lo & ~m) == (r.hi & ~m)) continue;
+            if((r.lo & m) != 0) {
+                todo.push_back({(r.lo | m) + 1, r.hi});
+                todo.push_back({r.lo, r.lo | m});
+                split = true;
+            } else if((r.hi & m) != m) {
+                todo.push_back({r.hi & ~m, r.hi});
+                todo.push_back({r.lo, (r.hi & ~m) - 1});
+                split = true;
+            }
+        }
+        if(split) continue;
+
+        unsigned char a[4], b[4];
+        int n = encode(r.lo, a);
+        encode(r.hi, b);
+        std::vector<ByteRange> seq;
+        for(int i = 0; i < n; i++) seq.push_back({a[i], b[i]});
+        out.push_back(seq);
+    }
+    return out;
+}
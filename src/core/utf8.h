@@ -0,0 +1,31 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Inclusive code point range
+struct CodeRange {
+    uint32_t lo;
+    uint32_t hi;
+};
+
+// Inclusive byte range
+struct ByteRange {
+    unsigned char lo;
+    unsigned char hi;
+};
+
+// Unicode identifier classes, sorted and non-overlapping (unicode_tables.cpp)
+extern const CodeRange XID_START[];
+extern const size_t XID_START_SIZE;
+extern const CodeRange XID_CONTINUE[];
+extern const size_t XID_CONTINUE_SIZE;
+
+// The UTF-8 encodings of [lo, hi] as sequences of byte ranges: a byte
+// string is the encoding of some code point in the range iff it matches
+// one sequence byte by byte. Surrogates are left out.
+std::vector<std::vector<ByteRange>> utf8Sequences(uint32_t lo, uint32_t hi);
+
+#endif // UTF8_H
@@ -376,11 +376,10 @@ MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
     // ============================================
     // Initialize backend
     // ============================================
-    nfa = buildCombinedNFA();
-    dfa = subsetConstruct(nfa);  // Keep real DFA for tokenization
+    nfa = buildCombinedNFA(true);  // Non-ASCII identifiers lex as ID
+    dfa = subsetConstruct(nfa, true);  // Keep real DFA for tokenization
     buildSimplifiedDFA();  // Build simplified DFA for visualization
     view->buildFromDFA(simplifiedDFA);  // Display simplified version
-    fillGrammar();
     
     // ============================================
     // Connect signals
@@ -454,7 +453,9 @@ void MainWindow::onBuildNFA() {
         view->clear();
     }
     
-    // Build the complete combined NFA (same as used for tokenization)
+    // Build the complete combined NFA. This is the ASCII spec: tokenization
+    // also takes non-ASCII identifiers (buildCombinedNFA(true)), but their
+    // UTF-8 byte states would swamp the diagram.
     FullNFA combinedNFA = buildCombinedNFA();
     
     trace->append("✅ NFA constructed using Thompson's Construction!");
@@ -487,12 +488,28 @@ void MainWindow::onBuildNFA() {
 void MainWindow::onLex() {
     tokensBox->clear();
     trace->clear();
+    std::string prev = cur;
     cur = input->text().toStdString();
-    tokens = tokenize(dfa, cur);
+    LexOptions lexOpts;
+    lexOpts.linearTime = true;
+    lexOpts.recoverErrors = true;
+    // Only rescan around what changed since the last lex
+    tokens = retokenize(dfa, tokens, cur, diffText(prev, cur), lexOpts);
+    
+    // Report every bad span in one pass, then reject the input
+    int lexErrors = 0;
+    for(const auto &tk : tokens) {
+        if(tk.id != TK_ERROR) continue;
+        trace->append(QString("❌ Lexical error at position %1: '%2'")
+            .arg(tk.pos)
+            .arg(QString::fromStdString(tk.lexeme)));
+        lexErrors++;
+    }
     
-    if(tokens.empty()) {
-        trace->append("❌ Lexical error.");
-        dfaInfo->setText("<b style='color:red;'>❌ Tokenization Failed</b><br>Invalid character detected.");
+    if(lexErrors > 0) {
+        tokens.clear();
+        dfaInfo->setText(QString("<b style='color:red;'>❌ Tokenization Failed</b><br>"
+                                 "%1 invalid character sequence(s) detected.").arg(lexErrors));
         return;
     }
     
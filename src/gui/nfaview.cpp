@@ -215,6 +215,11 @@ void NFAView::buildCombinedNFA(const FullNFA &nfa) {
                 transLabel = "[a-z, A-Z]";
             } else if(trans.kind == L_ALNUM_UNDERSCORE) {
                 transLabel = "[alnum_]";
+            } else if(trans.kind == L_ANY) {
+                transLabel = "Σ";
+            } else if(trans.kind == L_RANGE) {
+                transLabel = QString("[%1-%2]").arg((unsigned char)trans.ch, 2, 16, QChar('0'))
+                                               .arg((unsigned char)trans.hi, 2, 16, QChar('0'));
             }
             
             drawTransition(fromId, toId, transLabel, nfa);
@@ -1,45 +1,610 @@
 #include "tokenizer.h"
+#include "core/thompson.h"
 #include <algorithm>
+#include <utility>
 
-std::vector<Token> tokenize(const std::vector<DFAState> &dfa, const std::string &in) {
-    std::vector<Token> out;
+// Failed (state, position) pairs for linear-time maximal munch. Stored
+// position-major relative to `base` so it only grows as far as the scan goes.
+struct FailMemo {
+    int numStates = 0;
+    int base = 0;
+    std::vector<bool> failed;                 // [(pos - base) * numStates + state]
+    std::vector<std::pair<int, int>> trail;   // pairs visited by the current scan
+
+    bool has(int s, int pos) const {
+        size_t i = (size_t)(pos - base) * numStates + s;
+        return i < failed.size() && failed[i];
+    }
+    void mark(int s, int pos) {
+        size_t i = (size_t)(pos - base) * numStates + s;
+        if(i >= failed.size()) failed.resize((size_t)(pos - base + 1) * numStates * 2, false);
+        failed[i] = true;
+    }
+};
+
+// Longest match from DFA state `start` at `pos`. Returns the accepting DFA
+// state, or -1 if no prefix is accepted; `end` receives one past the last
+// accepted character. If `hash` is given it receives the SymbolTable hash of
+// the accepted lexeme, and `tags` the tag positions as of the last accept.
+// `scanned` receives one past the furthest character read (n + 1 if the
+// scan ran into the end of the input).
+static int longestMatch(const std::vector<DFAState> &dfa, const std::string &in, int start,
+                        int pos, int &end, FailMemo *memo, uint32_t *hash,
+                        std::array<int, TAG_COUNT> *tags, int *scanned = nullptr) {
     int n = in.size();
-    int pos = 0;
-    
+    int reach = n + 1;
+    int s = start;
+    int last = -1;
+    int lastPos = pos;
+    int cur = pos;
+    int count = 0; // Iterations of the active counted loop
+    uint32_t h = SymbolTable::HASH_SEED;
+    uint32_t lastHash = h;
+    std::array<int, TAG_COUNT> curTags = unsetTags(), lastTags = curTags;
+
+    if(tags) {
+        for(int tg : dfa[start].entryTags) curTags[tg] = pos;
+        lastTags = curTags;
+    }
+
+    if(memo) memo->trail.clear();
+
+    while(cur < n) {
+        char c = in[cur];
+        auto it = dfa[s].trans.find(c);
+        if(it == dfa[s].trans.end()) {
+            reach = cur + 1;
+            break;
+        }
+
+        if(tags && !dfa[s].tagOps.empty()) {
+            auto op = dfa[s].tagOps.find(c);
+            if(op != dfa[s].tagOps.end()) {
+                for(int tg : op->second) curTags[tg] = cur + 1;
+            }
+        }
+
+        int prev = s;
+        s = it->second;
+        cur++;
+        if(hash) h = SymbolTable::hashStep(h, c);
+
+        // Counted loop: advance the iteration count and swap in the variant
+        // state for it. The variants share ids across counts, so they are
+        // kept out of the memo.
+        const DFACounter &ctr = dfa[s].counter;
+        if(ctr.id >= 0) {
+            count = dfa[prev].counter.id == ctr.id ? count + 1 : 1;
+            if(count < ctr.min) s = ctr.belowMin;
+            else if(count >= ctr.max) s = ctr.atMax;
+        } else if(memo) {
+            if(memo->has(s, cur)) { // Known dead end, stop scanning
+                reach = cur;
+                break;
+            }
+            memo->trail.push_back({s, cur});
+        }
+        if(dfa[s].accept) {
+            last = s;
+            lastPos = cur;
+            lastHash = h;
+            if(tags) lastTags = curTags;
+        }
+    }
+
+    // Everything visited past the last accept can never reach one
+    if(memo) {
+        for(auto &p : memo->trail) {
+            if(p.second > lastPos) memo->mark(p.first, p.second);
+        }
+    }
+
+    end = lastPos;
+    if(hash) *hash = lastHash;
+    if(tags) *tags = lastTags;
+    if(scanned) *scanned = reach;
+    return last;
+}
+
+// Token with highest priority (lowest id) among those a DFA state accepts
+static int bestToken(const DFAState &st) {
+    return *std::min_element(st.tokens.begin(), st.tokens.end());
+}
+
+// False if the output cannot hold the token id
+static bool emit(std::vector<Token> &out, int id, const std::string &in, int pos, int len,
+                 int sym = -1, const std::array<int, TAG_COUNT> *tags = nullptr,
+                 int scanEnd = -1) {
+    out.push_back({id, id == 0 ? "$" : in.substr(pos, len), pos, sym});
+    if(tags) out.back().tags = *tags;
+    out.back().scanEnd = scanEnd;
+    return true;
+}
+
+// Tags and scan extents are not part of the compact encoding
+static bool emit(TokenStream &out, int id, const std::string &, int pos, int len,
+                 int sym = -1, const std::array<int, TAG_COUNT> * = nullptr, int = -1) {
+    return out.push(id, pos, len, sym);
+}
+
+// TK_ERROR recovery, shared by every scanning loop. Characters no token
+// can start at collect into one span from `errStart` (-1 while none is
+// open), which ends where the next token or the input does.
+//
+// No token starts at `pos`: add that character to the span and step past
+// it. Returns false, meaning a lexical error, when recovery is off.
+static bool skipUnmatched(const LexOptions &opts, int &errStart, int &pos) {
+    if(!opts.recoverErrors) return false;
+    if(errStart == -1) errStart = pos;
+    pos++;
+    return true;
+}
+
+// A token or the end of input was reached at `end`: close the open span,
+// if any, as [start, start + len)
+static bool closeError(int &errStart, int end, int &start, int &len) {
+    if(errStart == -1) return false;
+    start = errStart;
+    len = end - errStart;
+    errStart = -1;
+    return true;
+}
+
+// The single-mode lexer: always start in DFA state 0
+struct NoModes {
+    int start() const { return 0; }
+    void apply(int) {}
+};
+
+// Mode stack for a ModalDFA; token actions push and pop it
+struct ModeStack {
+    const ModalDFA &dfa;
+    std::vector<int> stack;
+
+    int start() const { return dfa.start[stack.back()]; }
+    void apply(int tk) {
+        const auto &actions = dfa.actions[stack.back()];
+        auto it = actions.find(tk);
+        if(it == actions.end()) return;
+        if(it->second.kind == MODE_PUSH) stack.push_back(it->second.mode);
+        else if(it->second.kind == MODE_POP && stack.size() > 1) stack.pop_back();
+    }
+};
+
+// Maximal-munch loop from `pos` to the end of `in`, appending to `out`.
+// Before each token is emitted, `sync(pos)` may stop the loop early; it is
+// only consulted at token boundaries with no error span pending.
+// A token's scanEnd covers every scan since the previous token was emitted,
+// skipped whitespace and failed scans included.
+// Returns false on a lexical error when error recovery is off.
+template <class Out, class Modes, class Sync>
+static bool lexFrom(const std::vector<DFAState> &dfa, const std::string &in, int pos,
+                    const LexOptions &opts, Out &out, Modes &modes, Sync &&sync) {
+    int n = in.size();
+
+    FailMemo memo;
+    memo.numStates = dfa.size();
+    memo.base = pos;
+
+    int errStart = -1;
+    int reach = pos; // Furthest scan extent since the last emitted token
+
     while(pos < n) {
-        int s = 0;
-        int last = -1;
-        int lastPos = pos;
-        int cur = pos;
+        int lastPos;
+        uint32_t hash;
+        std::array<int, TAG_COUNT> tags;
+        int scanned;
+        int last = longestMatch(dfa, in, modes.start(), pos, lastPos,
+                                opts.linearTime ? &memo : nullptr,
+                                opts.symbols || !opts.keywords.empty() ? &hash : nullptr, &tags,
+                                &scanned);
+        reach = std::max(reach, scanned);
+
+        int errPos, errLen;
+        if(last == -1) {
+            if(!skipUnmatched(opts, errStart, pos)) return false; // Lexical error
+            continue;
+        }
+        if(closeError(errStart, pos, errPos, errLen)) {
+            emit(out, TK_ERROR, in, errPos, errLen, -1, nullptr, reach);
+        }
+
+        if(sync(pos)) return true;
+
+        int tk = bestToken(dfa[last]);
+
+        if(tk == TK_ID && !opts.keywords.empty()) {
+            int kw = opts.keywords.lookup(in.data() + pos, lastPos - pos, hash);
+            if(kw >= 0) tk = kw;
+        }
+
+        int sym = -1;
+        if(tk == TK_ID && opts.symbols) {
+            sym = opts.symbols->intern(in.data() + pos, lastPos - pos, hash);
+        }
+
+        if(tk != TK_WS) { // Skip whitespace
+            if(!emit(out, tk, in, pos, lastPos - pos, sym, &tags, reach)) return false;
+            reach = lastPos;
+        }
+        modes.apply(tk);
+        pos = lastPos;
+    }
+
+    // An error span running to the end was cut short by the end itself
+    int errPos, errLen;
+    if(closeError(errStart, n, errPos, errLen)) {
+        emit(out, TK_ERROR, in, errPos, errLen, -1, nullptr, n + 1);
+    }
+
+    emit(out, 0, in, n, 0, -1, nullptr, n + 1); // EOF
+    return true;
+}
+
+std::vector<Token> tokenize(const std::vector<DFAState> &dfa, const std::string &in,
+                            const LexOptions &opts) {
+    std::vector<Token> out;
+    NoModes modes;
+    if(!lexFrom(dfa, in, 0, opts, out, modes, [](int) { return false; })) return {};
+    return out;
+}
+
+CompiledLexer compileLexer(const FullNFA &nfa, KeywordMap keywords) {
+    CompiledLexer lexer;
+    lexer.dfa = subsetConstruct(nfa);
+    lexer.keywords = keywords;
+    return lexer;
+}
+
+const CompiledLexer &builtinLexer() {
+    static const CompiledLexer lexer = compileLexer(buildCombinedNFA(true));
+    return lexer;
+}
+
+std::vector<Token> tokenize(const CompiledLexer &lexer, const std::string &in,
+                            const LexOptions &opts) {
+    LexOptions o = opts;
+    if(!lexer.keywords.empty()) o.keywords = lexer.keywords;
+    return tokenize(lexer.dfa, in, o);
+}
+
+LexCursor::LexCursor(const std::vector<DFAState> &d, const std::string &s, const LexOptions &o)
+    : dfa(&d), in(&s), opts(o) {
+    next();
+}
+
+LexCursor::LexCursor(const CompiledLexer &lexer, const std::string &s, const LexOptions &o)
+    : dfa(&lexer.dfa), in(&s), opts(o) {
+    if(!lexer.keywords.empty()) opts.keywords = lexer.keywords;
+    next();
+}
+
+void LexCursor::set(int id, int pos, int length, int sym) {
+    tk = id;
+    start = pos;
+    len = length;
+    symbol = sym;
+}
+
+// One iteration of lexFrom()'s loop per call, stopping at the next token
+// it would have emitted
+void LexCursor::next() {
+    if(finished) {
+        set(-1, in->size(), 0);
+        return;
+    }
+
+    const std::string &s = *in;
+    int n = s.size();
+    bool wantHash = opts.symbols || !opts.keywords.empty();
+
+    while(at < n) {
+        int lastPos;
+        uint32_t hash;
+        int last = longestMatch(*dfa, s, 0, at, lastPos, nullptr, wantHash ? &hash : nullptr, nullptr);
         
-        // Scan for longest match
-        while(cur < n) {
-            char c = in[cur];
-            auto it = dfa[s].trans.find(c);
-            if(it == dfa[s].trans.end()) break;
-            
-            s = it->second;
-            if(dfa[s].accept) {
-                last = s;
-                lastPos = cur + 1;
+        if(last == -1) {
+            if(!skipUnmatched(opts, errStart, at)) { // Lexical error
+                finished = error = true;
+                set(-1, at, 0);
+                return;
             }
-            cur++;
+            continue;
         }
         
-        if(last == -1) return {}; // Lexical error
+        // The token after an error span is matched again on the next call
+        int errPos, errLen;
+        if(closeError(errStart, at, errPos, errLen)) {
+            set(TK_ERROR, errPos, errLen);
+            return;
+        }
         
-        // Get token with highest priority
-        std::vector<int> cand = dfa[last].tokens;
-        std::sort(cand.begin(), cand.end());
-        int tk = cand.front();
-        std::string lex = in.substr(pos, lastPos - pos);
+        int id = bestToken((*dfa)[last]);
+        if(id == TK_ID && !opts.keywords.empty()) {
+            int kw = opts.keywords.lookup(s.data() + at, lastPos - at, hash);
+            if(kw >= 0) id = kw;
+        }
+        int sym = -1;
+        if(id == TK_ID && opts.symbols) {
+            sym = opts.symbols->intern(s.data() + at, lastPos - at, hash);
+        }
         
-        if(tk != TK_WS) { // Skip whitespace
-            out.push_back({tk, lex, pos});
+        int from = at;
+        at = lastPos;
+        if(id == TK_WS) continue; // Skip whitespace
+        set(id, from, lastPos - from, sym);
+        return;
+    }
+
+    int errPos, errLen;
+    if(closeError(errStart, n, errPos, errLen)) {
+        set(TK_ERROR, errPos, errLen);
+        return;
+    }
+
+    set(0, n, 0); // EOF
+    finished = true;
+}
+
+std::vector<Token> tokenizeModal(const ModalDFA &dfa, const std::string &in,
+                                 const LexOptions &opts) {
+    std::vector<Token> out;
+    ModeStack modes{dfa, {0}};
+    if(!lexFrom(dfa.states, in, 0, opts, out, modes, [](int) { return false; })) return {};
+    return out;
+}
+
+TokenStream tokenizeStream(const std::vector<DFAState> &dfa, const std::string &in,
+                           const LexOptions &opts) {
+    TokenStream out;
+    out.reserve(in.size() / 2 + 1);
+    NoModes modes;
+    if(!lexFrom(dfa, in, 0, opts, out, modes, [](int) { return false; })) return TokenStream();
+    return out;
+}
+
+std::vector<Token> tokenizeLazy(DerivativeDFA &dfa, const std::string &in,
+                                const LexOptions &opts) {
+    std::vector<Token> out;
+    int n = in.size();
+    int pos = 0;
+    int errStart = -1;
+
+    while(pos < n) {
+        int s = dfa.start();
+        int tk = -1;
+        int lastPos = pos;
+        for(int cur = pos; cur < n; cur++) {
+            s = dfa.next(s, in[cur]);
+            if(s == DerivativeDFA::DEAD) break;
+            if(dfa.token(s) >= 0) {
+                tk = dfa.token(s);
+                lastPos = cur + 1;
+            }
+        }
+
+        int errPos, errLen;
+        if(tk == -1) {
+            if(!skipUnmatched(opts, errStart, pos)) return {}; // Lexical error
+            continue;
+        }
+        if(closeError(errStart, pos, errPos, errLen)) emit(out, TK_ERROR, in, errPos, errLen);
+        if(tk != TK_WS) emit(out, tk, in, pos, lastPos - pos);
+        pos = lastPos;
+    }
+
+    int errPos, errLen;
+    if(closeError(errStart, n, errPos, errLen)) emit(out, TK_ERROR, in, errPos, errLen);
+    emit(out, 0, in, n, 0); // EOF
+    return out;
+}
+
+// Add `s` and everything it reaches by epsilon to `set`; mark[x] == gen
+// means x is already in it
+static void addClosure(const FullNFA &nfa, int s, std::vector<int> &set,
+                       std::vector<int> &mark, int gen) {
+    if(mark[s] == gen) return;
+    mark[s] = gen;
+    size_t from = set.size();
+    set.push_back(s);
+    for(size_t i = from; i < set.size(); i++) {
+        for(const auto &t : nfa.states[set[i]].trans) {
+            if(t.kind == L_EPS && mark[t.to] != gen) {
+                mark[t.to] = gen;
+                set.push_back(t.to);
+            }
+        }
+    }
+}
+
+std::vector<Token> tokenizeNFA(const FullNFA &nfa, const std::string &in,
+                               const LexOptions &opts) {
+    if(!nfa.counters.empty()) return {}; // Bounds would be ignored
+
+    std::vector<Token> out;
+    int n = in.size();
+
+    std::vector<int> acceptOf(nfa.states.size(), -1);
+    for(const auto &acc : nfa.acceptToken) acceptOf[acc.first] = acc.second;
+
+    std::vector<int> cur, next;
+    std::vector<int> mark(nfa.states.size(), 0);
+    int gen = 0;
+
+    int pos = 0;
+    int errStart = -1;
+    while(pos < n) {
+        cur.clear();
+        addClosure(nfa, nfa.start, cur, mark, ++gen);
+
+        int tk = -1;
+        int lastPos = pos;
+        for(int i = pos; i < n && !cur.empty(); i++) {
+            next.clear();
+            gen++;
+            for(int s : cur) {
+                for(const auto &t : nfa.states[s].trans) {
+                    if(t.kind != L_EPS && labelMatches(t.kind, in[i], t.ch, t.hi)) {
+                        addClosure(nfa, t.to, next, mark, gen);
+                    }
+                }
+            }
+            cur.swap(next);
+
+            // Lowest token id wins, like bestToken()
+            int best = -1;
+            for(int s : cur) {
+                if(acceptOf[s] >= 0 && (best == -1 || acceptOf[s] < best)) best = acceptOf[s];
+            }
+            if(best >= 0) {
+                tk = best;
+                lastPos = i + 1;
+            }
+        }
+
+        int errPos, errLen;
+        if(tk == -1) {
+            if(!skipUnmatched(opts, errStart, pos)) return {}; // Lexical error
+            continue;
         }
+        if(closeError(errStart, pos, errPos, errLen)) emit(out, TK_ERROR, in, errPos, errLen);
+        if(tk != TK_WS) emit(out, tk, in, pos, lastPos - pos);
         pos = lastPos;
     }
-    
-    out.push_back({0, "$", (int)in.size()}); // EOF
+
+    int errPos, errLen;
+    if(closeError(errStart, n, errPos, errLen)) emit(out, TK_ERROR, in, errPos, errLen);
+    emit(out, 0, in, n, 0); // EOF
+    return out;
+}
+
+LexEngine buildLexEngine(FullNFA nfa, const SubsetBudget &budget) {
+    LexEngine engine;
+    engine.dfa = subsetConstruct(nfa, budget, &engine.report);
+    if(!engine.report.ok) {
+        if(!nfa.counters.empty() && engine.report.error.empty()) {
+            engine.report.error = "DFA over budget (" + engine.report.exceeded +
+                                  ") and counted repetition cannot be simulated";
+        }
+        engine.fallback = engine.report.error.empty();
+    }
+    engine.nfa = std::move(nfa);
+    return engine;
+}
+
+std::vector<Token> tokenize(const LexEngine &engine, const std::string &in,
+                            const LexOptions &opts) {
+    if(!engine.usable()) return {};
+    if(engine.simulated()) return tokenizeNFA(engine.nfa, in, opts);
+    return tokenize(engine.dfa, in, opts);
+}
+
+std::vector<Match> findAll(const SearchDFA &dfa, const std::string &in) {
+    std::vector<Match> out;
+    int n = in.size();
+
+    // Backward pass with the unanchored reverse DFA: starts[i] is set if
+    // some match begins at offset i
+    std::vector<bool> starts(n, false);
+    const auto &rev = dfa.reverse;
+    int s = 0;
+    for(int i = n - 1; i >= 0; i--) {
+        if(s == 0) {
+            // Idle: skip bytes no match can end with
+            while(i >= 0 && !dfa.lastByte[(unsigned char)in[i]]) i--;
+            if(i < 0) break;
+        }
+
+        // The .* loop never dies, so a missing transition is a byte outside
+        // allChars(), which only the loop consumes
+        auto it = rev[s].trans.find(in[i]);
+        s = it == rev[s].trans.end() ? 0 : it->second;
+        if(rev[s].accept) starts[i] = true;
+    }
+
+    // Forward pass: leftmost start, then the longest match from it
+    int pos = 0;
+    while(pos < n) {
+        if(!starts[pos]) {
+            pos++;
+            continue;
+        }
+
+        int end;
+        int last = longestMatch(dfa.forward, in, 0, pos, end, nullptr, nullptr, nullptr);
+        if(last == -1) {
+            pos++;
+            continue;
+        }
+
+        out.push_back({bestToken(dfa.forward[last]), pos, end});
+        pos = end;
+    }
+
+    return out;
+}
+
+TextEdit diffText(const std::string &before, const std::string &after) {
+    size_t prefix = 0;
+    size_t maxPrefix = std::min(before.size(), after.size());
+    while(prefix < maxPrefix && before[prefix] == after[prefix]) prefix++;
+
+    size_t suffix = 0;
+    size_t maxSuffix = maxPrefix - prefix;
+    while(suffix < maxSuffix &&
+          before[before.size() - 1 - suffix] == after[after.size() - 1 - suffix]) {
+        suffix++;
+    }
+
+    TextEdit edit;
+    edit.offset = prefix;
+    edit.removed = before.size() - prefix - suffix;
+    edit.inserted = after.substr(prefix, after.size() - prefix - suffix);
+    return edit;
+}
+
+std::vector<Token> retokenize(const std::vector<DFAState> &dfa, const std::vector<Token> &old,
+                              const std::string &in, const TextEdit &edit,
+                              const LexOptions &opts) {
+    if(old.empty()) return tokenize(dfa, in, opts);
+
+    int delta = (int)edit.inserted.size() - edit.removed;
+    int editEnd = edit.offset + edit.inserted.size(); // End of the edit in the new text
+
+    // An old token is still valid if no scan that led to it read at or past
+    // the edit. Maximal munch can look arbitrarily far past a token's end,
+    // so this is decided by its scan extent, not its lexeme; lexing restarts
+    // right after the last valid token (the EOF token never is).
+    size_t keep = 0;
+    while(keep + 1 < old.size() && old[keep].scanEnd >= 0 && old[keep].scanEnd <= edit.offset) {
+        keep++;
+    }
+    int restart = keep > 0 ? old[keep - 1].pos + (int)old[keep - 1].lexeme.size() : 0;
+
+    std::vector<Token> out(old.begin(), old.begin() + keep);
+
+    // Once a new token boundary past the edit lands on an old boundary, the
+    // rest of the old stream is valid again, shifted by `delta`: each of
+    // those old tokens was scanned from past the edit, so its scans only
+    // read unchanged text.
+    size_t j = keep;
+    auto sync = [&](int pos) {
+        if(pos < editEnd) return false;
+        while(j < old.size() && old[j].pos < pos - delta) j++;
+        if(j == old.size() || old[j].pos != pos - delta) return false;
+
+        for(size_t i = j; i < old.size(); i++) {
+            out.push_back(old[i]);
+            out.back().pos += delta;
+            out.back().scanEnd += delta;
+            for(int &tg : out.back().tags) {
+                if(tg >= 0) tg += delta;
+            }
+        }
+        return true;
+    };
+
+    NoModes modes;
+    if(!lexFrom(dfa, in, restart, opts, out, modes, sync)) return {};
     return out;
-}
\ No newline at end of file
+}
@@ -3,9 +3,170 @@
 
 #include "core/tokens.h"
 #include "core/dfa.h"
+#include "core/modes.h"
+#include "core/search.h"
+#include "core/tokenstream.h"
+#include "core/symbols.h"
+#include "core/keywords.h"
+#include "core/derivative.h"
+#include "core/subset.h"
 #include <string>
 #include <vector>
 
-std::vector<Token> tokenize(const std::vector<DFAState> &dfa, const std::string &in);
+struct LexOptions {
+    // Guarantee O(n) scanning: remember (DFA state, position) pairs that are
+    // known not to reach an accepting state, so backtracking never rescans
+    // them (Reps, "Maximal-munch tokenization in linear time").
+    // Costs one bit per DFA state per input character.
+    bool linearTime = false;
 
-#endif // TOKENIZER_H
\ No newline at end of file
+    // Instead of failing on the first unmatched character, emit a TK_ERROR
+    // token covering the shortest run of characters no token can start at,
+    // then resynchronize and keep going.
+    bool recoverErrors = false;
+
+    // When set, TK_ID lexemes are interned here (hashed while scanning) and
+    // tokens carry the symbol id. Reuse one table across a batch.
+    SymbolTable *symbols = nullptr;
+
+    // Reserved words: an accepted TK_ID found here is reclassified to the
+    // keyword's token id (and is not interned).
+    KeywordMap keywords;
+};
+
+// A single edit to a text: `removed` characters at `offset` replaced by `inserted`
+struct TextEdit {
+    int offset = 0;
+    int removed = 0;
+    std::string inserted;
+};
+
+std::vector<Token> tokenize(const std::vector<DFAState> &dfa, const std::string &in,
+                            const LexOptions &opts = LexOptions());
+
+// A token spec compiled once: its DFA and reserved words. Never modified
+// after compileLexer() returns, so any number of threads can lex with one.
+struct CompiledLexer {
+    std::vector<DFAState> dfa;
+    KeywordMap keywords;
+};
+
+CompiledLexer compileLexer(const FullNFA &nfa, KeywordMap keywords = KeywordMap());
+
+// The built-in token spec with Unicode identifiers (built once)
+const CompiledLexer &builtinLexer();
+
+// Lex with the lexer's keywords; the other options come from `opts`
+std::vector<Token> tokenize(const CompiledLexer &lexer, const std::string &in,
+                            const LexOptions &opts = LexOptions());
+
+// Pull-based lexer: scans one token per next() call, so the token sequence
+// is never stored and memory stays constant however long the input is.
+// The current token is a parser's one token of lookahead; its lexeme is a
+// span of `in`, which must outlive the cursor. Whitespace is skipped and the
+// last token is EOF (id 0), as with tokenize(). Honors recoverErrors,
+// symbols and keywords; linearTime is not, since its memo grows with the
+// input. After EOF or a lexical error, valid() is false and id() is -1.
+class LexCursor {
+public:
+    LexCursor(const std::vector<DFAState> &dfa, const std::string &in,
+              const LexOptions &opts = LexOptions());
+    LexCursor(const CompiledLexer &lexer, const std::string &in,
+              const LexOptions &opts = LexOptions());
+
+    bool valid() const { return tk >= 0; }
+    bool failed() const { return error; }
+    void next();
+
+    int id() const { return tk; }
+    int pos() const { return start; }
+    int length() const { return len; }
+    int sym() const { return symbol; }
+    std::string lexeme() const { return tk == 0 ? "$" : in->substr(start, len); }
+
+private:
+    void set(int id, int pos, int length, int sym = -1);
+
+    const std::vector<DFAState> *dfa;
+    const std::string *in;
+    LexOptions opts;
+    int at = 0;        // Scan position
+    int errStart = -1; // Start of a pending TK_ERROR span
+    bool finished = false;
+    bool error = false;
+
+    int tk = -1;
+    int start = 0;
+    int len = 0;
+    int symbol = -1;
+};
+
+// Lex with start conditions: scanning starts in the current mode's DFA and
+// each token's ModeAction updates the mode stack. Starts in mode 0.
+std::vector<Token> tokenizeModal(const ModalDFA &dfa, const std::string &in,
+                                 const LexOptions &opts = LexOptions());
+
+// Same as tokenize(), producing the compact columnar encoding. Returns an
+// empty stream on a lexical error or a token id above TokenStream::MAX_ID.
+TokenStream tokenizeStream(const std::vector<DFAState> &dfa, const std::string &in,
+                           const LexOptions &opts = LexOptions());
+
+// Maximal munch on a derivative DFA, building its states as the scan
+// reaches them. Only LexOptions::recoverErrors is honored.
+std::vector<Token> tokenizeLazy(DerivativeDFA &dfa, const std::string &in,
+                                const LexOptions &opts = LexOptions());
+
+// Maximal munch by simulating the NFA directly: O(NFA size) per character,
+// no determinization. Only LexOptions::recoverErrors is honored. Counted
+// repetition cannot be enforced this way, so an NFA with counters is
+// refused like a lexical error.
+std::vector<Token> tokenizeNFA(const FullNFA &nfa, const std::string &in,
+                               const LexOptions &opts = LexOptions());
+
+// A token spec compiled under a SubsetBudget: its DFA if construction fit
+// the budget, otherwise just the NFA, which tokenize() then simulates. An
+// NFA with counted loops never falls back, since simulation would drop
+// their bounds: if its DFA does not fit, the engine is not usable() and
+// report.error says why.
+struct LexEngine {
+    FullNFA nfa;
+    std::vector<DFAState> dfa;
+    BudgetReport report;
+    bool fallback = false; // Lexing simulates `nfa`
+
+    bool usable() const { return report.ok || fallback; }
+    bool simulated() const { return fallback; }
+};
+
+LexEngine buildLexEngine(FullNFA nfa, const SubsetBudget &budget);
+
+// Fails (no tokens) on an engine that is not usable()
+std::vector<Token> tokenize(const LexEngine &engine, const std::string &in,
+                            const LexOptions &opts = LexOptions());
+
+// One occurrence found by findAll(): token id and [start, end) offsets
+struct Match {
+    int token;
+    int start;
+    int end;
+};
+
+// Every non-overlapping token occurrence in `in`, leftmost-longest, like
+// grep -o. A backward pass with the reverse DFA marks match starts, then
+// the forward DFA extends each leftmost start to its longest match.
+std::vector<Match> findAll(const SearchDFA &dfa, const std::string &in);
+
+// Smallest edit that turns `before` into `after` (common prefix/suffix)
+TextEdit diffText(const std::string &before, const std::string &after);
+
+// Incremental re-lex: `old` is the token stream of the text before `edit`,
+// `in` the text after it. Rescanning starts after the last old token whose
+// scans (Token::scanEnd) stayed clear of the edit and stops at the first
+// boundary past the edit that lines up with `old` again; the remaining old
+// tokens are reused with shifted positions. Tokens without a scanEnd are
+// rescanned.
+std::vector<Token> retokenize(const std::vector<DFAState> &dfa, const std::vector<Token> &old,
+                              const std::string &in, const TextEdit &edit,
+                              const LexOptions &opts = LexOptions());
+
+#endif // TOKENIZER_H
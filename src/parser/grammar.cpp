@@ -1,33 +1,186 @@
 #include "grammar.h"
 #include "core/tokens.h"
 
-std::vector<Production> prods;
-std::map<std::pair<std::string, std::string>, int> table;
-std::string startSym = "E";
-
 std::string tokenToTerm(int id) {
-    switch(id) {
-        case TK_ID: return "ID";
-        case TK_NUMBER: return "NUMBER";
-        case TK_PLUS: return "+";
-        case TK_MINUS: return "-";
-        case TK_STAR: return "*";
-        case TK_SLASH: return "/";
-        case TK_LPAREN: return "(";
-        case TK_RPAREN: return ")";
-        case 0: return "$";
-        default: return "";
+    if(id == 0) return "$";
+    if(id < 0 || id >= (int)tokenNames.size()) return "";
+    return tokenNames[id];
+}
+
+int CompiledGrammar::symbolId(const std::string &name) const {
+    for(size_t i = 0; i < symbolNames.size(); i++) {
+        if(symbolNames[i] == name) return i;
+    }
+    return -1;
+}
+
+int CompiledGrammar::lookup(const std::string &nonterminal, const std::string &terminal) const {
+    int a = symbolId(nonterminal);
+    int t = symbolId(terminal);
+    if(a < numTerminals || t < 0 || t >= numTerminals) return -1;
+    return predict(a, t);
+}
+
+static std::string productionText(const Production &p) {
+    std::string s = p.lhs + " ->";
+    for(const auto &x : p.rhs) s += " " + x;
+    return s;
+}
+
+std::string describeConflict(const CompiledGrammar &g, const LL1Conflict &c) {
+    return c.nonterminal + " on " + c.terminal + ": " + productionText(g.prods[c.first]) + " and " +
+           productionText(g.prods[c.second]) + " both apply";
+}
+
+void mapTokens(CompiledGrammar &g) {
+    g.tokenTerm.assign(tokenNames.size(), -1);
+    for(size_t id = 0; id < tokenNames.size(); id++) {
+        int t = g.symbolId(tokenToTerm(id));
+        if(t >= 0 && t < g.numTerminals) g.tokenTerm[id] = t;
+    }
+}
+
+void computeFirst(const CompiledGrammar &g, std::vector<TermSet> &first, std::vector<bool> &nullable) {
+    int numSymbols = g.symbolNames.size();
+    first.assign(numSymbols, TermSet(g.numTerminals));
+    nullable.assign(numSymbols, false);
+    for(int t = 0; t < g.numTerminals; t++) first[t].set(t);
+    
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(size_t p = 0; p < g.prodRhs.size(); p++) {
+            int a = g.prodLhs[p];
+            bool allNullable = true;
+            for(int x : g.prodRhs[p]) {
+                changed |= first[a].merge(first[x]);
+                if(!nullable[x]) {
+                    allNullable = false;
+                    break;
+                }
+            }
+            if(allNullable && !nullable[a]) {
+                nullable[a] = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+void computeFollow(const CompiledGrammar &g, const std::vector<TermSet> &first,
+                   const std::vector<bool> &nullable, std::vector<TermSet> &follow) {
+    int numTerminals = g.numTerminals;
+    follow.assign(g.symbolNames.size(), TermSet(numTerminals));
+    follow[g.startSym].set(END_SYM);
+    
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(size_t p = 0; p < g.prodRhs.size(); p++) {
+            const auto &rhs = g.prodRhs[p];
+            
+            // Walk right to left, carrying FIRST of the suffix after each symbol
+            TermSet trailer = follow[g.prodLhs[p]];
+            for(int i = rhs.size() - 1; i >= 0; i--) {
+                int x = rhs[i];
+                if(x < numTerminals) {
+                    trailer = first[x];
+                    continue;
+                }
+                changed |= follow[x].merge(trailer);
+                if(nullable[x]) trailer.merge(first[x]);
+                else trailer = first[x];
+            }
+        }
+    }
+}
+
+CompiledGrammar internGrammar(const std::vector<Production> &prods, const std::string &start) {
+    CompiledGrammar g;
+    g.prods = prods;
+    auto &symbolNames = g.symbolNames;
+    
+    std::map<std::string, int> ids;
+    
+    auto add = [&](const std::string &s) {
+        if(ids.count(s)) return;
+        ids[s] = symbolNames.size();
+        symbolNames.push_back(s);
+    };
+    
+    std::map<std::string, bool> isLhs;
+    for(auto &p : prods) isLhs[p.lhs] = true;
+    
+    add("$");
+    for(auto &p : prods) {
+        for(auto &s : p.rhs) {
+            if(s != "ε" && !isLhs.count(s)) add(s);
+        }
     }
+    g.numTerminals = symbolNames.size();
+    
+    add(start);
+    for(auto &p : prods) add(p.lhs);
+    g.startSym = ids[start];
+    
+    for(auto &p : prods) {
+        g.prodLhs.push_back(ids[p.lhs]);
+        std::vector<int> rhs;
+        for(auto &s : p.rhs) {
+            if(s != "ε") rhs.push_back(ids[s]);
+        }
+        g.prodRhs.push_back(rhs);
+    }
+    
+    mapTokens(g);
+    return g;
 }
 
-bool isTerminal(const std::string &s) {
-    return s == "$" || s == "ID" || s == "NUMBER" || 
-           s == "+" || s == "-" || s == "*" || s == "/" || 
-           s == "(" || s == ")";
+CompiledGrammar compileGrammar(const std::vector<Production> &prods, const std::string &start,
+                               std::vector<LL1Conflict> *conflicts) {
+    CompiledGrammar g = internGrammar(prods, start);
+    const auto &prodRhs = g.prodRhs;
+    const auto &lhs = g.prodLhs;
+    int numTerminals = g.numTerminals;
+    
+    std::vector<TermSet> first, follow;
+    std::vector<bool> nullable;
+    computeFirst(g, first, nullable);
+    computeFollow(g, first, nullable, follow);
+    
+    // Predict p = A -> α on FIRST(α), and on FOLLOW(A) if α is nullable
+    int numNonterminals = g.symbolNames.size() - numTerminals;
+    g.table.assign(numNonterminals * numTerminals, -1);
+    if(conflicts) conflicts->clear();
+    
+    for(size_t p = 0; p < prodRhs.size(); p++) {
+        TermSet predictSet(numTerminals);
+        bool allNullable = true;
+        for(int x : prodRhs[p]) {
+            predictSet.merge(first[x]);
+            if(!nullable[x]) {
+                allNullable = false;
+                break;
+            }
+        }
+        if(allNullable) predictSet.merge(follow[lhs[p]]);
+        
+        for(int t = 0; t < numTerminals; t++) {
+            if(!predictSet.test(t)) continue;
+            int &cell = g.table[(lhs[p] - numTerminals) * numTerminals + t];
+            if(cell >= 0 && cell != (int)p) {
+                if(conflicts) conflicts->push_back({g.symbolNames[lhs[p]], g.symbolNames[t], cell, (int)p});
+                continue;
+            }
+            cell = p;
+        }
+    }
+    
+    return g;
 }
 
-void fillGrammar() {
-    prods = {
+std::vector<Production> expressionGrammar() {
+    return {
         {"E",  {"T", "E'"}},
         {"E'", {"+", "T", "E'"}},
         {"E'", {"-", "T", "E'"}},
@@ -42,24 +195,9 @@ void fillGrammar() {
         {"F",  {"ID"}},
         {"F",  {"NUMBER"}}
     };
-    
-    std::vector<std::string> look = {"+", "-", "(", "ID", "NUMBER"};
-    for(auto &t : look) table[{"E", t}] = 0;
-    
-    table[{"E'", "+"}] = 1;
-    table[{"E'", "-"}] = 2;
-    table[{"E'", ")"}] = 3;
-    table[{"E'", "$"}] = 3;
-    
-    for(auto &t : look) table[{"T", t}] = 4;
-    
-    table[{"T'", "*"}] = 5;
-    table[{"T'", "/"}] = 6;
-    for(std::string t : {"+", "-", "$", ")"}) table[{"T'", t}] = 7;
-    
-    table[{"F", "+"}] = 8;
-    table[{"F", "-"}] = 9;
-    table[{"F", "("}] = 10;
-    table[{"F", "ID"}] = 11;
-    table[{"F", "NUMBER"}] = 12;
+}
+
+const CompiledGrammar &builtinGrammar() {
+    static const CompiledGrammar g = compileGrammar(expressionGrammar(), "E");
+    return g;
 }
\ No newline at end of file
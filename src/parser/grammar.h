@@ -1,6 +1,7 @@
 #ifndef GRAMMAR_H
 #define GRAMMAR_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
@@ -8,14 +9,104 @@
 struct Production { 
     std::string lhs; 
     std::vector<std::string> rhs; 
+    std::string prec = ""; // %prec symbol; empty means the rightmost terminal's (LR only)
 };
 
-extern std::vector<Production> prods;
-extern std::map<std::pair<std::string, std::string>, int> table;
-extern std::string startSym;
+enum Assoc { ASSOC_LEFT, ASSOC_RIGHT, ASSOC_NONASSOC };
 
-void fillGrammar();
+// One precedence declaration, e.g. `%left + -`. Later levels bind tighter.
+struct PrecLevel {
+    Assoc assoc;
+    std::vector<std::string> terminals;
+};
+
+const int END_SYM = 0; // Symbol id of "$"
+
+// A grammar compiled for LL(1) parsing. Terminals (symbols that are never
+// a left-hand side) get ids 0 .. numTerminals - 1 ("$" is 0), nonterminals
+// the ids after them. Never modified after compileGrammar() returns, so
+// any number of parsers on any number of threads can share one.
+struct CompiledGrammar {
+    std::vector<Production> prods;
+    std::vector<std::string> symbolNames;
+    int numTerminals = 0;
+    int startSym = -1;
+    std::vector<int> prodLhs;
+    std::vector<std::vector<int>> prodRhs; // Right-hand sides; empty for ε
+    std::vector<int> tokenTerm;            // Token id -> terminal id, -1 if none
+    
+    // Dense LL(1) table: production id at
+    // [(nonterminal - numTerminals) * numTerminals + terminal], -1 if none
+    std::vector<int> table;
+    
+    int predict(int nonterminal, int terminal) const {
+        return table[(nonterminal - numTerminals) * numTerminals + terminal];
+    }
+    bool isTerminal(int sym) const { return sym < numTerminals; }
+    
+    int symbolId(const std::string &name) const; // -1 if unknown
+    
+    // Table entry by symbol names, -1 if empty
+    int lookup(const std::string &nonterminal, const std::string &terminal) const;
+};
+
+// A table cell two productions compete for
+struct LL1Conflict {
+    std::string nonterminal;
+    std::string terminal;
+    int first;  // Production kept in the table (listed first)
+    int second; // Production that lost
+};
+
+// "S on a: S -> A x and S -> B x both apply", for error messages
+std::string describeConflict(const CompiledGrammar &g, const LL1Conflict &c);
+
+// Fixed-size set of terminal ids
+struct TermSet {
+    std::vector<uint64_t> words;
+    
+    explicit TermSet(int n = 0) : words((n + 63) / 64, 0) {}
+    void set(int t) { words[t / 64] |= 1ull << (t % 64); }
+    bool test(int t) const { return words[t / 64] >> (t % 64) & 1; }
+    
+    // this |= o; true if anything was added
+    bool merge(const TermSet &o) {
+        bool changed = false;
+        for(size_t i = 0; i < words.size(); i++) {
+            uint64_t w = words[i] | o.words[i];
+            changed |= w != words[i];
+            words[i] = w;
+        }
+        return changed;
+    }
+};
+
+// FIRST set and nullability of every symbol, as a fixpoint over all
+// productions. Only the interned fields of `g` are read, not its table.
+void computeFirst(const CompiledGrammar &g, std::vector<TermSet> &first, std::vector<bool> &nullable);
+
+// FOLLOW set of every nonterminal ("$" follows the start symbol), from the
+// FIRST sets and nullability computeFirst() produced
+void computeFollow(const CompiledGrammar &g, const std::vector<TermSet> &first,
+                   const std::vector<bool> &nullable, std::vector<TermSet> &follow);
+
+// Intern the symbols and productions and map token ids to terminals,
+// leaving the LL(1) table empty. What an LR table compiler starts from.
+CompiledGrammar internGrammar(const std::vector<Production> &prods, const std::string &start);
+
+// Intern the symbols, compute FIRST and FOLLOW, and fill the table.
+// Conflicts go to `conflicts`; none means the grammar is LL(1).
+CompiledGrammar compileGrammar(const std::vector<Production> &prods, const std::string &start,
+                               std::vector<LL1Conflict> *conflicts = nullptr);
+
+// Token id -> terminal mapping for a grammar whose symbols are interned
+void mapTokens(CompiledGrammar &g);
+
+// The built-in expression grammar, and its compiled form (built once)
+std::vector<Production> expressionGrammar();
+const CompiledGrammar &builtinGrammar();
+
+// Terminal name of a token id: its tokenNames entry, "$" for EOF
 std::string tokenToTerm(int id);
-bool isTerminal(const std::string &s);
 
-#endif // GRAMMAR_H
\ No newline at end of file
+#endif // GRAMMAR_H
@@ -0,0 +1,322 @@
+#include "grammarfile.h"
+#include "core/tokens.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+static const uint32_t ARTIFACT_MAGIC = 0x47314C4C; // "LL1G"
+static const uint32_t ARTIFACT_VERSION = 1;
+
+// Fixed-size artifact header; the arrays follow in this order:
+//   nameOffsets[numSymbols + 1], names[nameBytes] (padded to 4 bytes),
+//   prodLhs[numProds], rhsOffsets[numProds + 1], rhs[rhsTotal],
+//   table[(numSymbols - numTerminals) * numTerminals]
+struct ArtifactHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t numSymbols;
+    uint32_t numTerminals;
+    uint32_t startSym;
+    uint32_t numProds;
+    uint32_t nameBytes;
+    uint32_t rhsTotal;
+};
+
+static void fail(std::string *error, const std::string &msg) {
+    if(error) *error = msg;
+}
+
+bool parseGrammarText(const std::string &text, std::vector<Production> &out,
+                      std::string &start, std::string *error,
+                      std::vector<PrecLevel> *precedence) {
+    std::vector<Production> result;
+    std::vector<PrecLevel> levels;
+    std::string startName;
+    std::istringstream lines(text);
+    std::string line;
+    int lineNo = 0;
+    
+    while(std::getline(lines, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if(hash != std::string::npos) line.erase(hash);
+        
+        std::istringstream words(line);
+        std::vector<std::string> w;
+        std::string s;
+        while(words >> s) w.push_back(s);
+        if(w.empty()) continue;
+        
+        if(w[0] == "%start") {
+            if(w.size() != 2) {
+                fail(error, "line " + std::to_string(lineNo) + ": %start takes one symbol");
+                return false;
+            }
+            startName = w[1];
+            continue;
+        }
+        
+        if(w[0] == "%left" || w[0] == "%right" || w[0] == "%nonassoc") {
+            Assoc assoc = w[0] == "%left" ? ASSOC_LEFT : w[0] == "%right" ? ASSOC_RIGHT : ASSOC_NONASSOC;
+            levels.push_back({assoc, std::vector<std::string>(w.begin() + 1, w.end())});
+            continue;
+        }
+        
+        if(w.size() < 2 || w[1] != "->") {
+            fail(error, "line " + std::to_string(lineNo) + ": expected `lhs -> symbols`");
+            return false;
+        }
+        
+        std::vector<std::string> rhs;
+        std::string prec;
+        for(size_t i = 2; i <= w.size(); i++) {
+            if(i == w.size() || w[i] == "|") {
+                if(rhs.empty()) rhs.push_back("ε");
+                result.push_back({w[0], rhs, prec});
+                rhs.clear();
+                prec.clear();
+            } else if(w[i] == "%prec") {
+                if(i + 1 == w.size() || (i + 2 < w.size() && w[i + 2] != "|")) {
+                    fail(error, "line " + std::to_string(lineNo) + ": %prec takes one symbol at the end of an alternative");
+                    return false;
+                }
+                prec = w[++i];
+            } else if(w[i] != "ε") {
+                rhs.push_back(w[i]);
+            }
+        }
+    }
+    
+    if(result.empty()) {
+        fail(error, "grammar has no productions");
+        return false;
+    }
+    
+    out = result;
+    start = startName.empty() ? result[0].lhs : startName;
+    if(precedence) *precedence = levels;
+    return true;
+}
+
+uint64_t grammarHash(const std::string &text) {
+    uint64_t h = 14695981039346656037ull;
+    for(unsigned char c : text) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+bool writeGrammarArtifact(const std::string &path, const CompiledGrammar &g, uint64_t hash,
+                          std::string *error) {
+    ArtifactHeader hdr;
+    hdr.magic = ARTIFACT_MAGIC;
+    hdr.version = ARTIFACT_VERSION;
+    hdr.hash = hash;
+    hdr.numSymbols = g.symbolNames.size();
+    hdr.numTerminals = g.numTerminals;
+    hdr.startSym = g.startSym;
+    hdr.numProds = g.prodRhs.size();
+    
+    std::vector<uint32_t> nameOffsets{0};
+    std::string names;
+    for(auto &s : g.symbolNames) {
+        names += s;
+        nameOffsets.push_back(names.size());
+    }
+    hdr.nameBytes = names.size();
+    names.resize((names.size() + 3) / 4 * 4, '\0');
+    
+    std::vector<uint32_t> prodLhs(g.prodLhs.begin(), g.prodLhs.end());
+    std::vector<uint32_t> rhsOffsets{0}, rhs;
+    for(const auto &r : g.prodRhs) {
+        rhs.insert(rhs.end(), r.begin(), r.end());
+        rhsOffsets.push_back(rhs.size());
+    }
+    hdr.rhsTotal = rhs.size();
+    
+    // Write next to the target and rename, so a reader never sees a torn file
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        if(!f) {
+            fail(error, "cannot write " + tmp);
+            return false;
+        }
+        auto put = [&](const void *p, size_t n) { f.write((const char *)p, n); };
+        put(&hdr, sizeof hdr);
+        put(nameOffsets.data(), nameOffsets.size() * 4);
+        put(names.data(), names.size());
+        put(prodLhs.data(), prodLhs.size() * 4);
+        put(rhsOffsets.data(), rhsOffsets.size() * 4);
+        put(rhs.data(), rhs.size() * 4);
+        put(g.table.data(), g.table.size() * 4);
+        if(!f) {
+            fail(error, "write failed: " + tmp);
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    if(std::rename(tmp.c_str(), path.c_str()) != 0) {
+        fail(error, "cannot rename " + tmp + " to " + path);
+        return false;
+    }
+    return true;
+}
+
+bool loadGrammarArtifact(const std::string &path, CompiledGrammar &out, uint64_t expectHash,
+                         std::string *error) {
+    // One read into 4-byte words: everything is copied into `out` anyway,
+    // so mapping the file would not save the copy
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if(!f) {
+        fail(error, "cannot read " + path);
+        return false;
+    }
+    uint64_t size = f.tellg();
+    if(size < sizeof(ArtifactHeader) || size % 4 != 0) {
+        fail(error, path + " is truncated or corrupt");
+        return false;
+    }
+    std::vector<uint32_t> file(size / 4);
+    f.seekg(0);
+    if(!f.read((char *)file.data(), size)) {
+        fail(error, "cannot read " + path);
+        return false;
+    }
+    
+    ArtifactHeader hdr;
+    std::memcpy(&hdr, file.data(), sizeof hdr);
+    if(hdr.magic != ARTIFACT_MAGIC || hdr.version != ARTIFACT_VERSION) {
+        fail(error, path + " is not a grammar artifact");
+        return false;
+    }
+    if(expectHash && hdr.hash != expectHash) {
+        fail(error, path + " was built from different grammar text");
+        return false;
+    }
+    
+    // Sizes in 64 bits, each bounded by the file before they are summed,
+    // so no corrupt header can wrap them around
+    uint64_t numSymbols = hdr.numSymbols;
+    uint64_t numTerminals = hdr.numTerminals;
+    uint64_t numProds = hdr.numProds;
+    uint64_t nameWords = ((uint64_t)hdr.nameBytes + 3) / 4;
+    uint64_t rhsTotal = hdr.rhsTotal;
+    uint64_t available = (size - sizeof hdr) / 4;
+    if(numTerminals == 0 || numTerminals > numSymbols ||
+       hdr.startSym < numTerminals || hdr.startSym >= numSymbols ||
+       numSymbols >= available || numProds >= available || nameWords > available ||
+       rhsTotal > available) {
+        fail(error, path + " is truncated or corrupt");
+        return false;
+    }
+    uint64_t numNonterminals = numSymbols - numTerminals;
+    uint64_t tableSize = numNonterminals * numTerminals; // Both < 2^32
+    uint64_t words = (numSymbols + 1) + nameWords + numProds + (numProds + 1) + rhsTotal + tableSize;
+    if(words != available) {
+        fail(error, path + " is truncated or corrupt");
+        return false;
+    }
+    
+    // The header is 40 bytes, so every array below starts on a word
+    const uint32_t *p = file.data() + sizeof hdr / 4;
+    auto take = [&](uint64_t n) {
+        const uint32_t *a = p;
+        p += n;
+        return a;
+    };
+    const uint32_t *nameOffsets = take(numSymbols + 1);
+    const char *names = (const char *)take(nameWords);
+    const uint32_t *prodLhs = take(numProds);
+    const uint32_t *rhsOffsets = take(numProds + 1);
+    const uint32_t *rhs = take(rhsTotal);
+    const int32_t *cells = (const int32_t *)take(tableSize);
+    
+    for(uint64_t i = 0; i < numSymbols; i++) {
+        if(nameOffsets[i] > nameOffsets[i + 1] || nameOffsets[i + 1] > hdr.nameBytes) {
+            fail(error, path + " has a bad symbol table");
+            return false;
+        }
+    }
+    for(uint64_t i = 0; i < numProds; i++) {
+        if(prodLhs[i] < numTerminals || prodLhs[i] >= numSymbols ||
+           rhsOffsets[i] > rhsOffsets[i + 1] || rhsOffsets[i + 1] > rhsTotal) {
+            fail(error, path + " has a bad production");
+            return false;
+        }
+    }
+    for(uint64_t i = 0; i < rhsTotal; i++) {
+        if(rhs[i] >= numSymbols) {
+            fail(error, path + " has a bad production");
+            return false;
+        }
+    }
+    for(uint64_t i = 0; i < tableSize; i++) {
+        if(cells[i] < -1 || cells[i] >= (int64_t)numProds) {
+            fail(error, path + " has a bad table entry");
+            return false;
+        }
+    }
+    
+    CompiledGrammar g;
+    for(uint64_t i = 0; i < numSymbols; i++) {
+        g.symbolNames.emplace_back(names + nameOffsets[i], nameOffsets[i + 1] - nameOffsets[i]);
+    }
+    g.numTerminals = numTerminals;
+    g.startSym = hdr.startSym;
+    
+    for(uint64_t i = 0; i < numProds; i++) {
+        std::vector<int> ids(rhs + rhsOffsets[i], rhs + rhsOffsets[i + 1]);
+        Production prod{g.symbolNames[prodLhs[i]], {}};
+        for(int s : ids) prod.rhs.push_back(g.symbolNames[s]);
+        if(ids.empty()) prod.rhs.push_back("ε");
+        g.prods.push_back(prod);
+        g.prodLhs.push_back(prodLhs[i]);
+        g.prodRhs.push_back(ids);
+    }
+    
+    g.table.assign(cells, cells + tableSize);
+    mapTokens(g);
+    out = std::move(g);
+    return true;
+}
+
+bool loadGrammarFile(const std::string &path, const std::string &cacheDir, CompiledGrammar &out,
+                     std::vector<LL1Conflict> *conflicts, std::string *error) {
+    std::ifstream f(path, std::ios::binary);
+    if(!f) {
+        fail(error, "cannot read " + path);
+        return false;
+    }
+    std::ostringstream buf;
+    buf << f.rdbuf();
+    std::string text = buf.str();
+    
+    uint64_t hash = grammarHash(text);
+    char name[32];
+    std::snprintf(name, sizeof name, "%016llx.ll1", (unsigned long long)hash);
+    std::string cached = cacheDir + "/" + name;
+    
+    if(loadGrammarArtifact(cached, out, hash)) return true;
+    
+    std::vector<Production> parsed;
+    std::string start;
+    if(!parseGrammarText(text, parsed, start, error)) return false;
+    
+    std::vector<LL1Conflict> found;
+    CompiledGrammar g = compileGrammar(parsed, start, &found);
+    if(conflicts) *conflicts = found;
+    if(!found.empty()) {
+        std::string more = found.size() > 1 ? " (and " + std::to_string(found.size() - 1) + " more)" : "";
+        fail(error, path + ": not LL(1): " + describeConflict(g, found[0]) + more);
+        return false;
+    }
+    out = std::move(g);
+    
+    // A cache that cannot be written only costs the next launch a compile
+    writeGrammarArtifact(cached, out, hash);
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef GRAMMARFILE_H
+#define GRAMMARFILE_H
+
+#include "grammar.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Grammar text format, one rule per line:
+//
+//   # comment
+//   %start E
+//   E  -> T E'
+//   E' -> + T E' | - T E' | ε
+//
+// Symbols are separated by whitespace; `|` separates alternatives and an
+// empty alternative (or ε) is the empty string. Without %start, the first
+// left-hand side is the start symbol.
+//
+// For the LALR(1) generator, `%left`, `%right` and `%nonassoc` lines
+// declare precedence levels (later lines bind tighter), and `%prec X` at
+// the end of an alternative gives it the precedence of X. They go to
+// `precedence` when given; the LL(1) compiler ignores them.
+bool parseGrammarText(const std::string &text, std::vector<Production> &out,
+                      std::string &start, std::string *error = nullptr,
+                      std::vector<PrecLevel> *precedence = nullptr);
+
+// FNV-1a 64 of the grammar source, the key of its cached artifact
+uint64_t grammarHash(const std::string &text);
+
+// A compiled grammar (symbols, right-hand sides, dense table) as a binary
+// artifact stamped with `hash`. Native byte order.
+bool writeGrammarArtifact(const std::string &path, const CompiledGrammar &g, uint64_t hash,
+                          std::string *error = nullptr);
+
+// Read an artifact into `out`. Fails, leaving `out` untouched, if the file
+// is malformed (every header size is checked against the file's length) or
+// (when expectHash != 0) was built from different source.
+bool loadGrammarArtifact(const std::string &path, CompiledGrammar &out, uint64_t expectHash = 0,
+                         std::string *error = nullptr);
+
+// Load a grammar file through the artifact cache in `cacheDir`: a cached
+// artifact for the same content is loaded directly; otherwise the text is
+// parsed and compiled, and the artifact is written for the next launch.
+// A grammar that is not LL(1) fails, leaving `out` untouched, with its
+// conflicts in `conflicts` and the first one described in `error`.
+bool loadGrammarFile(const std::string &path, const std::string &cacheDir, CompiledGrammar &out,
+                     std::vector<LL1Conflict> *conflicts = nullptr, std::string *error = nullptr);
+
+#endif // GRAMMARFILE_H
@@ -0,0 +1,401 @@
+#include "lalr.h"
+#include <algorithm>
+#include <map>
+
+LRTable compileLALR(const std::vector<Production> &prods, const std::string &start,
+                    const std::vector<PrecLevel> &precedence, std::vector<LRConflict> *conflicts) {
+    LRTable out;
+    out.grammar = internGrammar(prods, start);
+    const CompiledGrammar &g = out.grammar;
+    int numTerminals = g.numTerminals;
+    int numSymbols = g.symbolNames.size();
+    int numNonterminals = numSymbols - numTerminals;
+    
+    // Productions plus the augmented S' -> S, numbered last
+    int numProds = g.prodRhs.size();
+    int augmented = numProds;
+    std::vector<std::vector<int>> rhs = g.prodRhs;
+    rhs.push_back({g.startSym});
+    
+    std::vector<std::vector<int>> prodsOf(numSymbols);
+    for(int p = 0; p < numProds; p++) prodsOf[g.prodLhs[p]].push_back(p);
+    
+    // An item is production p with the dot before rhs[p][dot]: item
+    // itemBase[p] + dot
+    std::vector<int> itemBase, itemProd, itemDot;
+    for(int p = 0; p <= numProds; p++) {
+        itemBase.push_back(itemProd.size());
+        for(size_t dot = 0; dot <= rhs[p].size(); dot++) {
+            itemProd.push_back(p);
+            itemDot.push_back(dot);
+        }
+    }
+    int numItems = itemProd.size();
+    auto next = [&](int item) {
+        const auto &r = rhs[itemProd[item]];
+        return itemDot[item] < (int)r.size() ? r[itemDot[item]] : -1;
+    };
+    
+    // FIRST and nullability of what follows the symbol after the dot
+    std::vector<TermSet> first;
+    std::vector<bool> nullable;
+    computeFirst(g, first, nullable);
+    std::vector<TermSet> restFirst(numItems, TermSet(numTerminals));
+    std::vector<bool> restNullable(numItems, true);
+    for(int p = 0; p <= numProds; p++) {
+        TermSet acc(numTerminals);
+        bool accNullable = true;
+        for(int dot = rhs[p].size() - 1; dot >= 0; dot--) {
+            restFirst[itemBase[p] + dot] = acc;
+            restNullable[itemBase[p] + dot] = accNullable;
+            int x = rhs[p][dot];
+            if(!nullable[x]) {
+                acc = first[x];
+                accNullable = false;
+            } else {
+                acc.merge(first[x]);
+            }
+        }
+    }
+    
+    // LR(0) automaton: states are identified by their sorted kernels;
+    // closures list the kernel items first
+    std::vector<std::vector<int>> kernels{{itemBase[augmented]}};
+    std::map<std::vector<int>, int> stateOf{{kernels[0], 0}};
+    std::vector<std::vector<int>> closures;
+    std::vector<std::vector<std::pair<int, int>>> trans; // (symbol, state)
+    std::vector<char> added(numSymbols);
+    
+    for(size_t s = 0; s < kernels.size(); s++) {
+        std::vector<int> items = kernels[s];
+        std::fill(added.begin(), added.end(), 0);
+        for(size_t k = 0; k < items.size(); k++) {
+            int x = next(items[k]);
+            if(x < numTerminals || added[x]) continue;
+            added[x] = 1;
+            for(int p : prodsOf[x]) items.push_back(itemBase[p]);
+        }
+    
+        std::map<int, std::vector<int>> advanced;
+        for(int item : items) {
+            int x = next(item);
+            if(x >= 0) advanced[x].push_back(item + 1);
+        }
+    
+        std::vector<std::pair<int, int>> edges;
+        for(auto &a : advanced) {
+            std::sort(a.second.begin(), a.second.end());
+            auto it = stateOf.find(a.second);
+            if(it == stateOf.end()) {
+                it = stateOf.emplace(a.second, kernels.size()).first;
+                kernels.push_back(a.second);
+            }
+            edges.push_back({a.first, it->second});
+        }
+        closures.push_back(items);
+        trans.push_back(edges);
+    }
+    int numStates = kernels.size();
+    auto target = [&](int s, int x) {
+        for(auto &e : trans[s]) {
+            if(e.first == x) return e.second;
+        }
+        return -1;
+    };
+    
+    // LALR(1) lookaheads by propagation: one node per (state, closure
+    // item). Lookaheads generated inside a closure are added up front; the
+    // ones passed on unchanged (into a closure whose rest is nullable, or
+    // across a transition) are edges, followed until nothing changes.
+    std::vector<int> nodeBase(numStates + 1, 0);
+    for(int s = 0; s < numStates; s++) nodeBase[s + 1] = nodeBase[s] + closures[s].size();
+    int numNodes = nodeBase[numStates];
+    std::vector<TermSet> la(numNodes, TermSet(numTerminals));
+    std::vector<std::vector<int>> succ(numNodes);
+    std::vector<int> posOf(numItems, -1);
+    
+    for(int s = 0; s < numStates; s++) {
+        const auto &items = closures[s];
+        for(size_t k = 0; k < items.size(); k++) posOf[items[k]] = k;
+    
+        for(size_t k = 0; k < items.size(); k++) {
+            int item = items[k];
+            int x = next(item);
+            if(x < 0) continue;
+            int node = nodeBase[s] + k;
+    
+            if(x >= numTerminals) {
+                for(int p : prodsOf[x]) {
+                    int j = nodeBase[s] + posOf[itemBase[p]];
+                    la[j].merge(restFirst[item]);
+                    if(restNullable[item] && j != node) succ[node].push_back(j);
+                }
+            }
+    
+            int t = target(s, x);
+            const auto &kernel = kernels[t];
+            int pos = std::lower_bound(kernel.begin(), kernel.end(), item + 1) - kernel.begin();
+            succ[node].push_back(nodeBase[t] + pos);
+        }
+    
+        for(int item : items) posOf[item] = -1;
+    }
+    la[nodeBase[0]].set(END_SYM);
+    
+    std::vector<int> work;
+    std::vector<char> queued(numNodes, 1);
+    for(int n = numNodes - 1; n >= 0; n--) work.push_back(n);
+    while(!work.empty()) {
+        int n = work.back();
+        work.pop_back();
+        queued[n] = 0;
+        for(int m : succ[n]) {
+            if(la[m].merge(la[n]) && !queued[m]) {
+                queued[m] = 1;
+                work.push_back(m);
+            }
+        }
+    }
+    
+    // Precedence levels of terminals and productions, -1 if none
+    std::map<std::string, std::pair<int, Assoc>> levelOf;
+    for(size_t l = 0; l < precedence.size(); l++) {
+        for(auto &name : precedence[l].terminals) levelOf[name] = {(int)l, precedence[l].assoc};
+    }
+    std::vector<int> termLevel(numTerminals, -1);
+    std::vector<Assoc> termAssoc(numTerminals, ASSOC_NONASSOC);
+    for(int t = 0; t < numTerminals; t++) {
+        auto it = levelOf.find(g.symbolNames[t]);
+        if(it == levelOf.end()) continue;
+        termLevel[t] = it->second.first;
+        termAssoc[t] = it->second.second;
+    }
+    std::vector<int> prodLevel(numProds, -1);
+    for(int p = 0; p < numProds; p++) {
+        if(!g.prods[p].prec.empty()) {
+            auto it = levelOf.find(g.prods[p].prec);
+            if(it != levelOf.end()) prodLevel[p] = it->second.first;
+            continue;
+        }
+        for(int i = rhs[p].size() - 1; i >= 0; i--) {
+            if(rhs[p][i] < numTerminals) {
+                prodLevel[p] = termLevel[rhs[p][i]];
+                break;
+            }
+        }
+    }
+    
+    // ACTION: all shifts first, then each reduction against what is there
+    out.numStates = numStates;
+    out.action.assign(numStates * numTerminals, LR_ERROR);
+    out.gotoTable.assign(numStates * numNonterminals, -1);
+    std::vector<char> blocked(numStates * numTerminals, 0); // %nonassoc errors
+    if(conflicts) conflicts->clear();
+    
+    for(int s = 0; s < numStates; s++) {
+        for(auto &e : trans[s]) {
+            if(e.first < numTerminals) out.action[s * numTerminals + e.first] = lrShift(e.second);
+            else out.gotoTable[s * numNonterminals + e.first - numTerminals] = e.second;
+        }
+    }
+    
+    for(int s = 0; s < numStates; s++) {
+        const auto &items = closures[s];
+        for(size_t k = 0; k < items.size(); k++) {
+            int item = items[k];
+            if(next(item) >= 0) continue;
+            int p = itemProd[item];
+            const TermSet &look = la[nodeBase[s] + k];
+    
+            for(int t = 0; t < numTerminals; t++) {
+                if(!look.test(t)) continue;
+                int &cell = out.action[s * numTerminals + t];
+                int reduce = p == augmented ? LR_ACCEPT : lrReduce(p);
+    
+                if(cell == LR_ERROR) {
+                    if(!blocked[s * numTerminals + t]) cell = reduce;
+                    continue;
+                }
+                if(cell == reduce) continue;
+    
+                if(lrIsShift(cell) && reduce != LR_ACCEPT && prodLevel[p] >= 0 && termLevel[t] >= 0) {
+                    if(prodLevel[p] > termLevel[t] ||
+                       (prodLevel[p] == termLevel[t] && termAssoc[t] == ASSOC_LEFT)) {
+                        cell = reduce;
+                    } else if(prodLevel[p] == termLevel[t] && termAssoc[t] == ASSOC_NONASSOC) {
+                        cell = LR_ERROR;
+                        blocked[s * numTerminals + t] = 1;
+                    }
+                    continue;
+                }
+    
+                int kept = cell;
+                int lost = reduce;
+                if(lrIsReduce(cell) && reduce != LR_ACCEPT && p < lrTarget(cell)) std::swap(kept, lost);
+                if(reduce == LR_ACCEPT) std::swap(kept, lost);
+                cell = kept;
+                if(conflicts) conflicts->push_back({s, g.symbolNames[t], kept, lost});
+            }
+        }
+    }
+    
+    return out;
+}
+
+std::vector<Production> expressionGrammarLR() {
+    return {
+        {"E", {"E", "+", "E"}},
+        {"E", {"E", "-", "E"}},
+        {"E", {"E", "*", "E"}},
+        {"E", {"E", "/", "E"}},
+        {"E", {"+", "E"}, "UNARY"},
+        {"E", {"-", "E"}, "UNARY"},
+        {"E", {"(", "E", ")"}},
+        {"E", {"ID"}},
+        {"E", {"NUMBER"}}
+    };
+}
+
+std::vector<PrecLevel> expressionPrecedence() {
+    return {
+        {ASSOC_LEFT, {"+", "-"}},
+        {ASSOC_LEFT, {"*", "/"}},
+        {ASSOC_RIGHT, {"UNARY"}}
+    };
+}
+
+const LRTable &builtinLRTable() {
+    static const LRTable table = compileLALR(expressionGrammarLR(), "E", expressionPrecedence());
+    return table;
+}
+
+LRSession::LRSession(const LRTable &t) : table(&t) {
+    stack.reserve(INITIAL_STACK);
+    nodes.reserve(INITIAL_STACK);
+    reset();
+}
+
+void LRSession::bind(const Token *tkns, size_t n) {
+    tokens = tkns;
+    ids = nullptr;
+    stream = nullptr;
+    count = n;
+}
+
+void LRSession::bind(const TokenStream &s) {
+    tokens = nullptr;
+    ids = s.idColumn().data();
+    stream = &s;
+    count = s.size();
+}
+
+void LRSession::begin(const Token *tkns, size_t n) {
+    bind(tkns, n);
+    reset();
+}
+
+void LRSession::begin(const TokenStream &stream) {
+    bind(stream);
+    reset();
+}
+
+void LRSession::reset() {
+    tree = nextTree;
+    stack.clear();
+    stack.push_back(0);
+    nodes.clear();
+    if(tree) nodes.push_back(NO_NODE);
+    root = NO_NODE;
+    ip = 0;
+    reduced = -1;
+    done = false;
+    accept = false;
+}
+
+void LRSession::tokenSpan(int i, uint32_t &pos, uint32_t &len) const {
+    if(tokens) {
+        pos = tokens[i].pos;
+        len = tokens[i].id == 0 ? 0 : tokens[i].lexeme.size();
+        return;
+    }
+    int start, length;
+    stream->span(i, start, length);
+    pos = start;
+    len = length;
+}
+
+bool LRSession::run() {
+    while(!done) {
+        if(!step()) return false;
+    }
+    return accept;
+}
+
+bool LRSession::step() {
+    if(done) return true;
+    if(ip >= (int)count) { // Ran out of tokens without seeing EOF
+        done = true;
+        return false;
+    }
+    
+    const CompiledGrammar &g = table->grammar;
+    int id = tokenAt(ip);
+    int term = id >= 0 && id < (int)g.tokenTerm.size() ? g.tokenTerm[id] : -1;
+    int cell = term < 0 ? LR_ERROR : table->actionAt(stack.back(), term);
+    reduced = -1;
+    
+    if(lrIsShift(cell)) {
+        stack.push_back(lrTarget(cell));
+        if(tree) {
+            uint32_t leaf = tree->add(term);
+            tokenSpan(ip, (*tree)[leaf].pos, (*tree)[leaf].len);
+            nodes.push_back(leaf);
+        }
+        ip++;
+        return true;
+    }
+    if(cell == LR_ACCEPT) {
+        done = true;
+        accept = true;
+        if(tree) root = nodes.back();
+        return true;
+    }
+    if(cell == LR_ERROR) {
+        done = true;
+        return false;
+    }
+    
+    // Reduce: pop the right-hand side's states, then take GOTO on the lhs
+    int p = lrTarget(cell);
+    size_t n = g.prodRhs[p].size();
+    stack.resize(stack.size() - n);
+    stack.push_back(table->gotoAt(stack.back(), g.prodLhs[p]));
+    reduced = p;
+    
+    if(tree) {
+        // The popped entries' nodes become the children, in order
+        uint32_t parent = tree->add(g.prodLhs[p]);
+        TreeNode &node = (*tree)[parent];
+        tokenSpan(ip, node.pos, node.len);
+        node.len = 0;
+        
+        // Spans cover the non-empty children only, as in ParseSession
+        const uint32_t *kids = nodes.data() + nodes.size() - n;
+        uint32_t start = NO_NODE, end = 0;
+        for(size_t i = 0; i < n; i++) {
+            const TreeNode &child = (*tree)[kids[i]];
+            if(i + 1 < n) (*tree)[kids[i]].nextSibling = kids[i + 1];
+            if(child.len == 0) continue;
+            if(start == NO_NODE) start = child.pos;
+            end = child.pos + child.len;
+        }
+        if(n > 0) node.firstChild = kids[0];
+        if(start != NO_NODE) {
+            node.pos = start;
+            node.len = end - start;
+        }
+        nodes.resize(nodes.size() - n);
+        nodes.push_back(parent);
+    }
+    return true;
+}
@@ -0,0 +1,123 @@
+#ifndef LALR_H
+#define LALR_H
+
+#include "core/tokens.h"
+#include "core/tokenstream.h"
+#include "grammar.h"
+#include "tree.h"
+#include <climits>
+#include <string>
+#include <vector>
+
+// ACTION cell encoding: 0 is an error, s + 1 shifts to state s, -(p + 1)
+// reduces by production p, LR_ACCEPT accepts
+const int LR_ERROR = 0;
+const int LR_ACCEPT = INT_MIN;
+
+inline int lrShift(int state) { return state + 1; }
+inline int lrReduce(int prod) { return -prod - 1; }
+inline bool lrIsShift(int cell) { return cell > 0; }
+inline bool lrIsReduce(int cell) { return cell < 0 && cell != LR_ACCEPT; }
+inline int lrTarget(int cell) { return cell > 0 ? cell - 1 : -cell - 1; }
+
+// LALR(1) tables over the same interned symbols as the LL(1) compiler.
+// Never modified after compileLALR() returns, so any number of sessions
+// on any number of threads can share one.
+struct LRTable {
+    CompiledGrammar grammar; // Symbols, productions and token mapping; no LL(1) table
+    int numStates = 0;
+    
+    // ACTION[state * numTerminals + terminal]
+    std::vector<int> action;
+    // GOTO[state * numNonterminals + (nonterminal - numTerminals)], -1 if none
+    std::vector<int> gotoTable;
+    
+    int actionAt(int state, int terminal) const {
+        return action[state * grammar.numTerminals + terminal];
+    }
+    int gotoAt(int state, int nonterminal) const {
+        int numNonterminals = grammar.symbolNames.size() - grammar.numTerminals;
+        return gotoTable[state * numNonterminals + nonterminal - grammar.numTerminals];
+    }
+};
+
+// An ACTION cell two actions competed for that precedence did not settle.
+// Like yacc, shift wins a shift/reduce conflict and the production listed
+// first wins a reduce/reduce conflict.
+struct LRConflict {
+    int state;
+    std::string terminal;
+    int kept; // ACTION cell left in the table
+    int lost; // ACTION cell that was dropped
+};
+
+// Build the LR(0) automaton and its LALR(1) lookaheads, then fill ACTION
+// and GOTO. A production's precedence is its %prec symbol's, or else its
+// rightmost terminal's; a shift/reduce conflict between a production and a
+// terminal that both have one goes to the tighter side, and on a tie to
+// reduce (%left), shift (%right) or error (%nonassoc).
+LRTable compileLALR(const std::vector<Production> &prods, const std::string &start,
+                    const std::vector<PrecLevel> &precedence = std::vector<PrecLevel>(),
+                    std::vector<LRConflict> *conflicts = nullptr);
+
+// The expression language as a left-recursive grammar resolved by
+// precedence, and its tables (built once). Accepts exactly what the LL(1)
+// expression grammar accepts.
+std::vector<Production> expressionGrammarLR();
+std::vector<PrecLevel> expressionPrecedence();
+const LRTable &builtinLRTable();
+
+// One shift-reduce parse over a borrowed token sequence, the LR
+// counterpart of ParseSession: same borrowing rules, and the state stack
+// keeps its capacity across parses.
+class LRSession {
+public:
+    explicit LRSession(const LRTable &table = builtinLRTable());
+    
+    void bind(const Token *tokens, size_t count);
+    void bind(const TokenStream &tokens);
+    void begin(const Token *tokens, size_t count);
+    void begin(const std::vector<Token> &tokens) { begin(tokens.data(), tokens.size()); }
+    void begin(const TokenStream &tokens);
+    void reset();
+    
+    // Build the parse tree into `arena` from the next reset() or begin() on,
+    // as ParseSession::buildTree() does. Nodes are added bottom-up, so
+    // children come before their parent.
+    void buildTree(TreeArena *arena) { nextTree = arena; }
+    uint32_t treeRoot() const { return root; }
+    
+    bool step(); // One shift or one reduction
+    bool run();  // Step until done; true if the input is accepted
+    
+    bool isDone() const { return done; }
+    bool accepted() const { return accept; }
+    int position() const { return ip; }
+    int lastReduction() const { return reduced; } // Production of the last step, -1 after a shift
+    const std::vector<int> &stateStack() const { return stack; }
+
+private:
+    static const size_t INITIAL_STACK = 256;
+    
+    int tokenAt(int i) const { return tokens ? tokens[i].id : ids[i]; }
+    void tokenSpan(int i, uint32_t &pos, uint32_t &len) const;
+    
+    const LRTable *table;
+    const Token *tokens = nullptr; // Either a Token span ...
+    const uint16_t *ids = nullptr; // ... or a TokenStream id column
+    const TokenStream *stream = nullptr;
+    size_t count = 0;
+    
+    TreeArena *tree = nullptr;     // Arena of the current parse
+    TreeArena *nextTree = nullptr; // Taken over by the next reset()
+    std::vector<uint32_t> nodes; // Tree node of each stack entry, when building
+    uint32_t root = NO_NODE;
+    
+    std::vector<int> stack; // LR states
+    int ip;
+    int reduced;
+    bool done;
+    bool accept;
+};
+
+#endif // LALR_H
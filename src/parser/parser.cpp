@@ -1,49 +1,159 @@
 #include "parser.h"
+#include "lexer/tokenizer.h"
+#include <climits>
 
-Parser::Parser() {
+ParseSession::ParseSession(const CompiledGrammar &g) : grammar(&g) {
+    stack.reserve(INITIAL_STACK);
+    nodes.reserve(INITIAL_STACK);
     reset();
 }
 
-void Parser::reset() {
-    stack = {"$", "E"};
+void ParseSession::bind(const Token *tkns, size_t n) {
+    tokens = tkns;
+    ids = nullptr;
+    stream = nullptr;
+    lexer = nullptr;
+    count = n;
+}
+
+void ParseSession::bind(const TokenStream &s) {
+    tokens = nullptr;
+    ids = s.idColumn().data();
+    stream = &s;
+    lexer = nullptr;
+    count = s.size();
+}
+
+void ParseSession::bind(LexCursor &l) {
+    tokens = nullptr;
+    ids = nullptr;
+    stream = nullptr;
+    lexer = &l;
+    pulled = l.id();
+    count = INT_MAX; // Not known up front; the lexer ends with EOF
+}
+
+void ParseSession::begin(LexCursor &l) {
+    bind(l);
+    reset();
+}
+
+void ParseSession::begin(const Token *tkns, size_t n) {
+    bind(tkns, n);
+    reset();
+}
+
+void ParseSession::begin(const TokenStream &stream) {
+    bind(stream);
+    reset();
+}
+
+void ParseSession::reset() {
+    tree = nextTree;
+    stack.clear();
+    stack.push_back(END_SYM);
+    stack.push_back(grammar->startSym);
+    nodes.clear();
+    root = NO_NODE;
+    if(tree) {
+        root = tree->add(grammar->startSym);
+        nodes.push_back(NO_NODE);
+        nodes.push_back(root);
+    }
     ip = 0;
     done = false;
     pdaState = 0;
 }
 
-bool Parser::parseAll(const std::vector<Token> &tkns) {
-    tokens = tkns;
-    reset();
+void ParseSession::tokenSpan(int i, uint32_t &pos, uint32_t &len) const {
+    if(tokens) {
+        pos = tokens[i].pos;
+        len = tokens[i].id == 0 ? 0 : tokens[i].lexeme.size();
+        return;
+    }
+    if(lexer) { // Only the current token is available, which is all a step asks for
+        pos = lexer->pos();
+        len = lexer->length();
+        return;
+    }
+    int start, length;
+    stream->span(i, start, length);
+    pos = start;
+    len = length;
+}
+
+// A nonterminal spans its non-empty children, so ε subtrees at either end
+// do not pull in the whitespace around them. Children are always added
+// after their parent, so one backward sweep over this parse's nodes sees
+// every child first.
+void ParseSession::finishTree() {
+    for(uint32_t i = tree->size(); i-- > root; ) {
+        TreeNode &n = (*tree)[i];
+        if(n.firstChild == NO_NODE) continue;
+        uint32_t start = NO_NODE, end = 0;
+        for(uint32_t c = n.firstChild; c != NO_NODE; c = (*tree)[c].nextSibling) {
+            const TreeNode &child = (*tree)[c];
+            if(child.len == 0) continue;
+            if(start == NO_NODE) start = child.pos;
+            end = child.pos + child.len;
+        }
+        n.pos = start == NO_NODE ? (*tree)[n.firstChild].pos : start;
+        n.len = start == NO_NODE ? 0 : end - start;
+    }
+}
+
+std::vector<std::string> ParseSession::stackNames() const {
+    std::vector<std::string> names;
+    names.reserve(stack.size());
+    for(int s : stack) names.push_back(grammar->symbolNames[s]);
+    return names;
+}
+
+bool ParseSession::run() {
     while(!done) {
-        if(!stepParse(tokens)) return false;
+        if(!step()) return false;
     }
     return true;
 }
 
-bool Parser::stepParse(const std::vector<Token> &tkns) {
+bool ParseSession::step() {
     if(done) return true;
     if(stack.empty()) { 
         done = true; 
         return true; 
     }
+    if(ip >= (int)count) { // Ran out of tokens without seeing EOF
+        done = true;
+        return false;
+    }
     
-    tokens = tkns;
-    std::string top = stack.back();
-    int id = tokens[ip].id;
-    std::string term = tokenToTerm(id);
+    int id = tokenAt(ip);
+    int top = stack.back();
+    const CompiledGrammar &g = *grammar;
+    int term = id >= 0 && id < (int)g.tokenTerm.size() ? g.tokenTerm[id] : -1;
     
     // Accept condition
-    if(top == "$" && term == "$") {
+    if(top == END_SYM && term == END_SYM) {
         done = true;
         pdaState = 1;
+        if(tree) finishTree();
         return true;
     }
     
     // Terminal matching
-    if(isTerminal(top)) {
+    if(g.isTerminal(top)) {
         if(top == term) {
+            if(tree) {
+                TreeNode &n = (*tree)[nodes.back()];
+                tokenSpan(ip, n.pos, n.len);
+                nodes.pop_back();
+            }
             stack.pop_back();
             ip++;
+            if(lexer) {
+                lexer->next();
+                pulled = lexer->id();
+            }
             return true;
         }
         done = true;
@@ -51,21 +161,77 @@ bool Parser::stepParse(const std::vector<Token> &tkns) {
     }
     
     // Non-terminal: lookup production
-    auto it = table.find({top, term});
-    if(it == table.end()) {
+    int pid = term < 0 ? -1 : g.predict(top, term);
+    if(pid < 0) {
         done = true;
         return false;
     }
     
-    int pid = it->second;
     stack.pop_back();
-    auto &rhs = prods[pid].rhs;
+    auto &rhs = g.prodRhs[pid];
+    for(int i = rhs.size() - 1; i >= 0; i--) {
+        stack.push_back(rhs[i]);
+    }
     
-    if(!(rhs.size() == 1 && rhs[0] == "ε")) {
-        for(int i = rhs.size() - 1; i >= 0; i--) {
-            stack.push_back(rhs[i]);
+    if(tree) {
+        // Children in order, pushed in reverse alongside their symbols
+        uint32_t parent = nodes.back();
+        nodes.pop_back();
+        if(rhs.empty()) {
+            TreeNode &n = (*tree)[parent];
+            tokenSpan(ip, n.pos, n.len);
+            n.len = 0;
+            return true;
         }
+        uint32_t first = tree->size();
+        for(size_t i = 0; i < rhs.size(); i++) {
+            uint32_t child = tree->add(rhs[i]);
+            if(i > 0) (*tree)[child - 1].nextSibling = child;
+        }
+        (*tree)[parent].firstChild = first;
+        for(int i = rhs.size() - 1; i >= 0; i--) nodes.push_back(first + i);
     }
     
     return true;
-}
\ No newline at end of file
+}
+
+std::unique_ptr<ParseSession> ParseSessionPool::acquire() {
+    if(free.empty()) return std::unique_ptr<ParseSession>(new ParseSession(grammar));
+    
+    auto session = std::move(free.back());
+    free.pop_back();
+    session->reset();
+    return session;
+}
+
+void ParseSessionPool::release(std::unique_ptr<ParseSession> session) {
+    free.push_back(std::move(session));
+}
+
+Parser::Parser(const CompiledGrammar &grammar) : session(grammar) {}
+
+void Parser::reset() {
+    session.reset();
+}
+
+bool Parser::parseAll(const std::vector<Token> &tkns) {
+    session.begin(tkns);
+    return session.run();
+}
+
+bool Parser::parseAll(const TokenStream &stream) {
+    session.begin(stream);
+    return session.run();
+}
+
+bool Parser::parseAll(LexCursor &lexer) {
+    session.begin(lexer);
+    return session.run();
+}
+
+bool Parser::stepParse(const std::vector<Token> &tkns) {
+    // Re-borrowing is just a pointer update, so the caller may pass the
+    // same vector on every step
+    session.bind(tkns.data(), tkns.size());
+    return session.step();
+}
@@ -2,29 +2,120 @@
 #define PARSER_H
 
 #include "core/tokens.h"
+#include "core/tokenstream.h"
 #include "grammar.h"
+#include "tree.h"
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
 
-class Parser {
+class LexCursor;
+
+// One LL(1) parse over a borrowed token sequence. The tokens are never
+// copied; they must stay alive and unchanged while the session reads them.
+// reset() and begin() reuse the stack's capacity, so one session can run
+// any number of parses without allocating once it has warmed up.
+// The grammar is only read, so sessions on different threads may share it.
+class ParseSession {
 public:
-    Parser();
+    explicit ParseSession(const CompiledGrammar &grammar = builtinGrammar());
     
-    bool parseAll(const std::vector<Token> &tokens);
-    bool stepParse(const std::vector<Token> &tokens);
+    // Borrow a token sequence (ending in the EOF token) without touching
+    // the parse state; begin() also resets it
+    void bind(const Token *tokens, size_t count);
+    void bind(const TokenStream &tokens);
+    void begin(const Token *tokens, size_t count);
+    void begin(const std::vector<Token> &tokens) { begin(tokens.data(), tokens.size()); }
+    void begin(const TokenStream &tokens);
     void reset();
     
-    std::vector<std::string> getStack() const { return stack; }
+    // Pull tokens from a lexer instead: each matched terminal advances it,
+    // so the input is lexed and parsed in one pass with no token storage.
+    // Rebinding the same cursor mid-parse keeps its position.
+    void bind(LexCursor &lexer);
+    void begin(LexCursor &lexer);
+    
+    // Build the parse tree into `arena` from the next reset() or begin()
+    // on (nullptr stops). Each parse appends its nodes; the tree is
+    // complete once the input is accepted.
+    void buildTree(TreeArena *arena) { nextTree = arena; }
+    uint32_t treeRoot() const { return root; }
+    
+    bool step();
+    bool run(); // Step until done; true if the input is accepted
+    
     bool isDone() const { return done; }
-    int getCurrentPosition() const { return ip; }
-    int getPDAState() const { return pdaState; }
+    bool accepted() const { return pdaState == 1; }
+    int position() const { return ip; }
+    int pdaStateId() const { return pdaState; }
+    const std::vector<int> &stackIds() const { return stack; }
+    std::vector<std::string> stackNames() const;
     
 private:
-    std::vector<std::string> stack;
+    static const size_t INITIAL_STACK = 256;
+    
+    int tokenAt(int i) const { return tokens ? tokens[i].id : ids ? ids[i] : pulled; }
+    void tokenSpan(int i, uint32_t &pos, uint32_t &len) const;
+    void finishTree();
+    
+    const CompiledGrammar *grammar;
+    const Token *tokens = nullptr; // Either a Token span ...
+    const uint16_t *ids = nullptr; // ... or a TokenStream id column ...
+    const TokenStream *stream = nullptr;
+    LexCursor *lexer = nullptr;    // ... or a lexer, whose current token is `pulled`
+    int pulled = -1;
+    size_t count = 0;
+    
+    TreeArena *tree = nullptr;     // Arena of the current parse
+    TreeArena *nextTree = nullptr; // Taken over by the next reset()
+    std::vector<uint32_t> nodes; // Tree node of each stack entry, when building
+    uint32_t root = NO_NODE;
+    
+    std::vector<int> stack; // Grammar symbol ids
     int ip;
     bool done;
     int pdaState; // 0 = reading, 1 = accept
-    std::vector<Token> tokens;
 };
 
-#endif // PARSER_H
\ No newline at end of file
+// Recycles sessions for batch parsing: acquire() hands out a reset session,
+// release() takes it back for the next caller
+class ParseSessionPool {
+public:
+    explicit ParseSessionPool(const CompiledGrammar &grammar = builtinGrammar()) : grammar(grammar) {}
+    
+    std::unique_ptr<ParseSession> acquire();
+    void release(std::unique_ptr<ParseSession> session);
+    
+private:
+    const CompiledGrammar &grammar;
+    std::vector<std::unique_ptr<ParseSession>> free;
+};
+
+// Step-by-step parser for the GUI, on top of a ParseSession
+class Parser {
+public:
+    explicit Parser(const CompiledGrammar &grammar = builtinGrammar());
+    
+    bool parseAll(const std::vector<Token> &tokens);
+    bool parseAll(const TokenStream &tokens);
+    bool parseAll(LexCursor &tokens);
+    bool stepParse(const std::vector<Token> &tokens);
+    void reset();
+    
+    void buildTree(TreeArena *arena) { session.buildTree(arena); }
+    uint32_t treeRoot() const { return session.treeRoot(); }
+    
+    // Stack symbols by name, bottom first. Builds strings; the parse
+    // itself only ever touches stackIds().
+    std::vector<std::string> getStack() const { return session.stackNames(); }
+    const std::vector<int> &stackIds() const { return session.stackIds(); }
+    bool isDone() const { return session.isDone(); }
+    int getCurrentPosition() const { return session.position(); }
+    int getPDAState() const { return session.pdaStateId(); }
+    
+private:
+    ParseSession session;
+};
+
+#endif // PARSER_H
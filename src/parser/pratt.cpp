@@ -0,0 +1,90 @@
+#include "pratt.h"
+
+const PrattTable &expressionPrattTable() {
+    static const PrattTable table = [] {
+        PrattTable t;
+        size_t n = tokenNames.size();
+        t.infixLeft.assign(n, 0);
+        t.infixRight.assign(n, 0);
+        t.prefix.assign(n, 0);
+        t.atom.assign(n, 0);
+    
+        t.infixLeft[TK_PLUS] = t.infixLeft[TK_MINUS] = 1;
+        t.infixRight[TK_PLUS] = t.infixRight[TK_MINUS] = 2;
+        t.infixLeft[TK_STAR] = t.infixLeft[TK_SLASH] = 3;
+        t.infixRight[TK_STAR] = t.infixRight[TK_SLASH] = 4;
+        t.prefix[TK_PLUS] = t.prefix[TK_MINUS] = 5;
+        t.atom[TK_ID] = t.atom[TK_NUMBER] = 1;
+        return t;
+    }();
+    return table;
+}
+
+PrattParser::PrattParser(const PrattTable &t) : table(&t) {}
+
+bool PrattParser::parse(const Token *tkns, size_t n) {
+    tokens = tkns;
+    ids = nullptr;
+    count = n;
+    return run();
+}
+
+bool PrattParser::parse(const TokenStream &stream) {
+    tokens = nullptr;
+    ids = stream.idColumn().data();
+    count = stream.size();
+    return run();
+}
+
+bool PrattParser::run() {
+    const PrattTable &t = *table;
+    int numIds = t.atom.size();
+    ops.clear();
+    powers.clear();
+    out.clear();
+    
+    // Alternates between expecting an operand (prefix operators and '('
+    // stay in that mode) and expecting an operator (')' stays in that mode)
+    bool operand = true;
+    for(size_t i = 0; i < count; i++) {
+        int id = tokenAt(i);
+        if(id < 0 || id >= numIds) return false;
+    
+        if(operand) {
+            if(t.atom[id]) {
+                out.push_back(i);
+                operand = false;
+            } else if(t.prefix[id]) {
+                ops.push_back(-(int)i - 1);
+                powers.push_back(t.prefix[id]);
+            } else if(id == t.open) {
+                ops.push_back(i);
+                powers.push_back(0);
+            } else {
+                return false;
+            }
+            continue;
+        }
+    
+        // An operator ends every pending one that binds tighter than it
+        int left = id == 0 || id == t.close ? 0 : t.infixLeft[id];
+        if(id != 0 && id != t.close && !left) return false;
+        while(!powers.empty() && powers.back() > left) {
+            out.push_back(ops.back());
+            ops.pop_back();
+            powers.pop_back();
+        }
+    
+        if(id == 0) return ops.empty(); // An unclosed '(' is left
+        if(id == t.close) {
+            if(ops.empty()) return false;
+            ops.pop_back();
+            powers.pop_back();
+            continue;
+        }
+        ops.push_back(i);
+        powers.push_back(t.infixRight[id]);
+        operand = true;
+    }
+    return false; // Ran out of tokens without seeing EOF
+}
@@ -0,0 +1,58 @@
+#ifndef PRATT_H
+#define PRATT_H
+
+#include "core/tokens.h"
+#include "core/tokenstream.h"
+#include <vector>
+
+// Binding powers by token id for an operator-precedence (Pratt) parse.
+// An infix operator binds its left operand with `infixLeft` and its right
+// one with `infixRight`: left-associative operators have left < right.
+// 0 means the token is not that kind of operator.
+struct PrattTable {
+    std::vector<int> infixLeft;
+    std::vector<int> infixRight;
+    std::vector<int> prefix;    // Binding power of a prefix operator's operand
+    std::vector<char> atom;     // Tokens that are a whole operand
+    int open = TK_LPAREN;
+    int close = TK_RPAREN;
+};
+
+// The expression grammar's operators: + - and * / left-associative, * /
+// tighter, and prefix + - tighter than both (F -> + F | - F)
+const PrattTable &expressionPrattTable();
+
+// Operator-precedence parser: one loop iteration per token, no
+// nonterminal expansions. It takes Pratt's binding powers but runs them as
+// a shunting-yard loop: pending operators wait on an explicit stack (kept
+// across parses) instead of in recursive nud/led calls, so nesting depth is
+// not limited by the call stack. Accepts exactly the inputs the LL(1)
+// expression parser accepts.
+//
+// The tree comes out as RPN over token indices: operands and infix
+// operators as their index, prefix operators as -(index + 1).
+class PrattParser {
+public:
+    explicit PrattParser(const PrattTable &table = expressionPrattTable());
+    
+    bool parse(const Token *tokens, size_t count);
+    bool parse(const std::vector<Token> &tokens) { return parse(tokens.data(), tokens.size()); }
+    bool parse(const TokenStream &tokens);
+    
+    const std::vector<int> &rpn() const { return out; }
+
+private:
+    bool run();
+    int tokenAt(size_t i) const { return tokens ? tokens[i].id : ids[i]; }
+    
+    const PrattTable *table;
+    const Token *tokens = nullptr;
+    const uint16_t *ids = nullptr;
+    size_t count = 0;
+    
+    std::vector<int> ops;    // Pending operators, RPN-encoded; '(' as its index
+    std::vector<int> powers; // Right binding power of each; 0 for '('
+    std::vector<int> out;
+};
+
+#endif // PRATT_H
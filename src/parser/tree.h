@@ -0,0 +1,60 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+const uint32_t NO_NODE = UINT32_MAX;
+
+// One parse tree node: a grammar symbol id and the span of input it
+// covers. Children are a first-child / next-sibling list of arena indices;
+// the lexeme is never copied, only referenced by offset and length.
+struct TreeNode {
+    int32_t symbol;
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    uint32_t pos;
+    uint32_t len;
+};
+
+// Bump allocator for parse trees. Nodes are appended to one contiguous
+// block and refer to each other by 32-bit index, so growing the block
+// never invalidates a tree. Any number of trees can share an arena, and
+// reset() drops them all at once: nodes are trivially destructible, so it
+// only rewinds the end and keeps the capacity for the next batch.
+//
+//   TreeArena arena;
+//   parser.buildTree(&arena);
+//   for(auto &tokens : batch) {
+//       parser.parseAll(tokens);
+//       use(arena, parser.treeRoot());
+//       arena.reset();
+//   }
+class TreeArena {
+public:
+    uint32_t add(int symbol, uint32_t pos = 0, uint32_t len = 0) {
+        nodes.push_back({symbol, NO_NODE, NO_NODE, pos, len});
+        return nodes.size() - 1;
+    }
+
+    TreeNode &operator[](uint32_t i) { return nodes[i]; }
+    const TreeNode &operator[](uint32_t i) const { return nodes[i]; }
+    size_t size() const { return nodes.size(); }
+
+    void reserve(size_t n) { nodes.reserve(n); }
+    void reset() { nodes.clear(); }
+
+    // The node's lexeme (or, for a nonterminal, the text it spans) in `src`
+    std::string_view text(uint32_t i, std::string_view src) const {
+        return src.substr(nodes[i].pos, nodes[i].len);
+    }
+
+    size_t memoryBytes() const { return nodes.capacity() * sizeof(TreeNode); }
+
+private:
+    std::vector<TreeNode> nodes;
+};
+
+#endif // TREE_H
@@ -1,9 +1,33 @@
 #include "validator.h"
 
+struct TokenVectorView {
+    const std::vector<Token> &tokens;
+    size_t size() const { return tokens.size(); }
+    int id(size_t i) const { return tokens[i].id; }
+    const std::string &lexeme(size_t i) const { return tokens[i].lexeme; }
+};
+
+struct TokenStreamView {
+    const TokenStream &tokens;
+    const std::string &src;
+    size_t size() const { return tokens.size(); }
+    int id(size_t i) const { return tokens.id(i); }
+    std::string lexeme(size_t i) const { return tokens.lexeme(i, src); }
+};
+
 ValidationResult ExpressionValidator::validate(const std::vector<Token> &tokens) {
+    return run(TokenVectorView{tokens});
+}
+
+ValidationResult ExpressionValidator::validate(const TokenStream &tokens, const std::string &src) {
+    return run(TokenStreamView{tokens, src});
+}
+
+template <class View>
+ValidationResult ExpressionValidator::run(const View &tokens) {
     ValidationResult result = {true, "", -1};
     
-    if(tokens.empty() || (tokens.size() == 1 && tokens[0].id == 0)) {
+    if(tokens.size() == 0 || (tokens.size() == 1 && tokens.id(0) == 0)) {
         result.valid = false;
         result.error = "Empty expression";
         return result;
@@ -36,18 +60,19 @@ ValidationResult ExpressionValidator::validate(const std::vector<Token> &tokens)
     return result;
 }
 
-bool ExpressionValidator::checkBalancedParentheses(const std::vector<Token> &tokens, 
+template <class View>
+bool ExpressionValidator::checkBalancedParentheses(const View &tokens, 
                                                     std::string &error, int &pos) {
     int balance = 0;
     int openPos = -1;
     
     for(size_t i = 0; i < tokens.size(); i++) {
-        if(tokens[i].id == 0) continue; // Skip EOF
+        if(tokens.id(i) == 0) continue; // Skip EOF
         
-        if(tokens[i].id == TK_LPAREN) {
+        if(tokens.id(i) == TK_LPAREN) {
             balance++;
             if(openPos == -1) openPos = i;
-        } else if(tokens[i].id == TK_RPAREN) {
+        } else if(tokens.id(i) == TK_RPAREN) {
             balance--;
             if(balance < 0) {
                 error = "Unmatched closing parenthesis ')'";
@@ -66,20 +91,21 @@ bool ExpressionValidator::checkBalancedParentheses(const std::vector<Token> &tok
     return true;
 }
 
-bool ExpressionValidator::checkAdjacentOperators(const std::vector<Token> &tokens, 
+template <class View>
+bool ExpressionValidator::checkAdjacentOperators(const View &tokens, 
                                                   std::string &error, int &pos) {
     for(size_t i = 0; i < tokens.size() - 1; i++) {
-        if(tokens[i].id == 0 || tokens[i].id == TK_WS) continue;
-        if(tokens[i+1].id == 0 || tokens[i+1].id == TK_WS) continue;
+        if(tokens.id(i) == 0 || tokens.id(i) == TK_WS) continue;
+        if(tokens.id(i+1) == 0 || tokens.id(i+1) == TK_WS) continue;
         
         // Check for two adjacent operators (excluding parentheses)
-        bool currIsOp = (tokens[i].id == TK_PLUS || tokens[i].id == TK_MINUS || 
-                        tokens[i].id == TK_STAR || tokens[i].id == TK_SLASH);
-        bool nextIsOp = (tokens[i+1].id == TK_PLUS || tokens[i+1].id == TK_MINUS || 
-                        tokens[i+1].id == TK_STAR || tokens[i+1].id == TK_SLASH);
+        bool currIsOp = (tokens.id(i) == TK_PLUS || tokens.id(i) == TK_MINUS || 
+                        tokens.id(i) == TK_STAR || tokens.id(i) == TK_SLASH);
+        bool nextIsOp = (tokens.id(i+1) == TK_PLUS || tokens.id(i+1) == TK_MINUS || 
+                        tokens.id(i+1) == TK_STAR || tokens.id(i+1) == TK_SLASH);
         
         if(currIsOp && nextIsOp) {
-            error = "Adjacent operators '" + tokens[i].lexeme + tokens[i+1].lexeme + 
+            error = "Adjacent operators '" + tokens.lexeme(i) + tokens.lexeme(i+1) + 
                    "' are not allowed";
             pos = i;
             return false;
@@ -89,14 +115,15 @@ bool ExpressionValidator::checkAdjacentOperators(const std::vector<Token> &token
     return true;
 }
 
-bool ExpressionValidator::checkOperatorPlacement(const std::vector<Token> &tokens, 
+template <class View>
+bool ExpressionValidator::checkOperatorPlacement(const View &tokens, 
                                                   std::string &error, int &pos) {
     // Find first non-whitespace token
     int firstReal = -1;
     int lastReal = -1;
     
     for(size_t i = 0; i < tokens.size(); i++) {
-        if(tokens[i].id != 0 && tokens[i].id != TK_WS) {
+        if(tokens.id(i) != 0 && tokens.id(i) != TK_WS) {
             if(firstReal == -1) firstReal = i;
             lastReal = i;
         }
@@ -109,18 +136,18 @@ bool ExpressionValidator::checkOperatorPlacement(const std::vector<Token> &token
     }
     
     // Check if starts with binary operator (not allowed at top level)
-    int firstId = tokens[firstReal].id;
+    int firstId = tokens.id(firstReal);
     if(firstId == TK_PLUS || firstId == TK_STAR || firstId == TK_SLASH) {
-        error = "Expression cannot start with operator '" + tokens[firstReal].lexeme + "'";
+        error = "Expression cannot start with operator '" + tokens.lexeme(firstReal) + "'";
         pos = firstReal;
         return false;
     }
     
     // Check if ends with operator
-    int lastId = tokens[lastReal].id;
+    int lastId = tokens.id(lastReal);
     if(lastId == TK_PLUS || lastId == TK_MINUS || 
        lastId == TK_STAR || lastId == TK_SLASH) {
-        error = "Expression cannot end with operator '" + tokens[lastReal].lexeme + "'";
+        error = "Expression cannot end with operator '" + tokens.lexeme(lastReal) + "'";
         pos = lastReal;
         return false;
     }
@@ -128,7 +155,8 @@ bool ExpressionValidator::checkOperatorPlacement(const std::vector<Token> &token
     return true;
 }
 
-bool ExpressionValidator::checkUnaryOperatorsInParens(const std::vector<Token> &tokens, 
+template <class View>
+bool ExpressionValidator::checkUnaryOperatorsInParens(const View &tokens, 
                                                        std::string &error, int &pos) {
     // Check: unary +/- must be inside parentheses
     // Valid: (−3), (+5), a+(−b)
@@ -138,7 +166,7 @@ bool ExpressionValidator::checkUnaryOperatorsInParens(const std::vector<Token> &
     int prevNonWS = -1; // Previous non-whitespace token index
     
     for(size_t i = 0; i < tokens.size(); i++) {
-        int id = tokens[i].id;
+        int id = tokens.id(i);
         
         if(id == TK_WS || id == 0) continue;
         
@@ -162,7 +190,7 @@ bool ExpressionValidator::checkUnaryOperatorsInParens(const std::vector<Token> &
                 // First token - it's unary
                 isUnary = true;
             } else {
-                int prevId = tokens[prevNonWS].id;
+                int prevId = tokens.id(prevNonWS);
                 // Unary if previous is operator or opening paren
                 if(prevId == TK_PLUS || prevId == TK_MINUS || 
                    prevId == TK_STAR || prevId == TK_SLASH ||
@@ -173,8 +201,8 @@ bool ExpressionValidator::checkUnaryOperatorsInParens(const std::vector<Token> &
             
             // If unary and NOT inside parentheses, reject
             if(isUnary && parenDepth == 0) {
-                error = "Unary operator '" + tokens[i].lexeme + 
-                       "' must be enclosed in parentheses, e.g., (" + tokens[i].lexeme + "3)";
+                error = "Unary operator '" + tokens.lexeme(i) + 
+                       "' must be enclosed in parentheses, e.g., (" + tokens.lexeme(i) + "3)";
                 pos = i;
                 return false;
             }
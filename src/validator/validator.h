@@ -2,6 +2,7 @@
 #define VALIDATOR_H
 
 #include "core/tokens.h"
+#include "core/tokenstream.h"
 #include <vector>
 #include <string>
 
@@ -14,12 +15,16 @@ struct ValidationResult {
 class ExpressionValidator {
 public:
     static ValidationResult validate(const std::vector<Token> &tokens);
+    // Columnar stream; lexemes for error messages are sliced from `src`
+    static ValidationResult validate(const TokenStream &tokens, const std::string &src);
     
 private:
-    static bool checkBalancedParentheses(const std::vector<Token> &tokens, std::string &error, int &pos);
-    static bool checkAdjacentOperators(const std::vector<Token> &tokens, std::string &error, int &pos);
-    static bool checkOperatorPlacement(const std::vector<Token> &tokens, std::string &error, int &pos);
-    static bool checkUnaryOperatorsInParens(const std::vector<Token> &tokens, std::string &error, int &pos);
+    // The checks run over a view with size(), id(i) and lexeme(i)
+    template <class View> static ValidationResult run(const View &tokens);
+    template <class View> static bool checkBalancedParentheses(const View &tokens, std::string &error, int &pos);
+    template <class View> static bool checkAdjacentOperators(const View &tokens, std::string &error, int &pos);
+    template <class View> static bool checkOperatorPlacement(const View &tokens, std::string &error, int &pos);
+    template <class View> static bool checkUnaryOperatorsInParens(const View &tokens, std::string &error, int &pos);
     static bool isBinaryOperator(int tokenId);
     static bool isUnaryOperator(int tokenId);
     static bool isOperand(int tokenId);
@@ -0,0 +1,875 @@
+// Regression tests for the automata, lexer and parser libraries. Every
+// test runs; a failed CHECK is reported and the exit status is nonzero.
+
+#include "core/thompson.h"
+#include "core/subset.h"
+#include "core/search.h"
+#include "core/modes.h"
+#include "core/incremental.h"
+#include "core/utf8.h"
+#include "core/symbols.h"
+#include "lexer/tokenizer.h"
+#include "parser/grammarfile.h"
+#include "parser/parser.h"
+#include "parser/lalr.h"
+#include "parser/pratt.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if(!(cond)) {                                                          \
+            std::printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                        \
+        }                                                                      \
+    } while(0)
+
+// What `fn` writes to std::cout
+static std::string stdoutOf(const std::function<void()> &fn) {
+    std::ostringstream out;
+    std::streambuf *saved = std::cout.rdbuf(out.rdbuf());
+    fn();
+    std::cout.rdbuf(saved);
+    return out.str();
+}
+
+// An NFA accepting each literal as the token id at the same index
+static FullNFA literalsNFA(const std::vector<std::string> &words, const std::vector<int> &ids) {
+    FullNFA nfa;
+    nfa.start = nfa.newState();
+    for(size_t i = 0; i < words.size(); i++) {
+        NFAFragment f = makeAtomic(nfa, L_CHAR, words[i][0]);
+        for(size_t c = 1; c < words[i].size(); c++) {
+            f = concatFrag(nfa, f, makeAtomic(nfa, L_CHAR, words[i][c]));
+        }
+        nfa.states[nfa.start].trans.emplace_back(f.start, L_EPS, 0);
+        nfa.acceptToken[f.accept] = ids[i];
+    }
+    return nfa;
+}
+
+static bool sameTokens(const std::vector<Token> &a, const std::vector<Token> &b) {
+    if(a.size() != b.size()) return false;
+    for(size_t i = 0; i < a.size(); i++) {
+        if(a[i].id != b[i].id || a[i].pos != b[i].pos || a[i].lexeme != b[i].lexeme) return false;
+    }
+    return true;
+}
+
+// Maximal munch for the first token reads past the edit even though the
+// token itself ends before it
+static void testRetokenizeLookahead() {
+    auto dfa = subsetConstruct(literalsNFA({"a", "aaab", "c", "b"}, {1, 2, 3, 4}));
+    std::string before = "aaac", after = "aaab";
+    auto old = tokenize(dfa, before);
+    CHECK(old.size() == 5);
+
+    auto edited = retokenize(dfa, old, after, diffText(before, after));
+    CHECK(sameTokens(edited, tokenize(dfa, after)));
+    CHECK(edited.size() == 2 && edited[0].id == 2 && edited[0].lexeme == "aaab");
+}
+
+// Random edits on a spec with long lookahead, errors and whitespace
+static void testRetokenizeRandom() {
+    FullNFA nfa = literalsNFA({"a", "aaab", "c", "b", " ", "ab"}, {1, 2, 3, 4, TK_WS, 5});
+    auto dfa = subsetConstruct(nfa);
+    LexOptions opts;
+    opts.recoverErrors = true;
+
+    std::mt19937 rng(28);
+    const std::string alphabet = "aabc x";
+    auto randomText = [&](size_t n) {
+        std::string s;
+        for(size_t i = 0; i < n; i++) s += alphabet[rng() % alphabet.size()];
+        return s;
+    };
+
+    for(int iter = 0; iter < 2000; iter++) {
+        std::string before = randomText(rng() % 24);
+        std::string after = before;
+        size_t at = before.empty() ? 0 : rng() % (before.size() + 1);
+        size_t removed = std::min<size_t>(rng() % 4, before.size() - at);
+        after.replace(at, removed, randomText(rng() % 4));
+
+        auto old = tokenize(dfa, before, opts);
+        auto edited = retokenize(dfa, old, after, diffText(before, after), opts);
+        if(!sameTokens(edited, tokenize(dfa, after, opts))) {
+            std::printf("  retokenize \"%s\" -> \"%s\"\n", before.c_str(), after.c_str());
+            CHECK(false);
+            return;
+        }
+    }
+}
+
+// (a|b)* a (a|b)^n: the DFA needs 2^(n+1) states
+static FullNFA blowupNFA(int n) {
+    FullNFA nfa;
+    nfa.start = nfa.newState();
+    auto ab = [&]() {
+        return unionFrag(nfa, makeAtomic(nfa, L_CHAR, 'a'), makeAtomic(nfa, L_CHAR, 'b'));
+    };
+    NFAFragment f = concatFrag(nfa, starFrag(nfa, ab()), makeAtomic(nfa, L_CHAR, 'a'));
+    for(int i = 0; i < n; i++) f = concatFrag(nfa, f, ab());
+    nfa.states[nfa.start].trans.emplace_back(f.start, L_EPS, 0);
+    nfa.acceptToken[f.accept] = 1;
+    return nfa;
+}
+
+static void testParallelMatchesSerial() {
+    FullNFA nfa = blowupNFA(11); // Several batches
+    auto serial = subsetConstruct(nfa);
+    auto parallel = subsetConstructParallel(nfa, 4);
+    CHECK(serial.size() == parallel.size());
+    bool same = serial.size() == parallel.size();
+    for(size_t i = 0; same && i < serial.size(); i++) {
+        same = serial[i].trans == parallel[i].trans && serial[i].accept == parallel[i].accept;
+    }
+    CHECK(same);
+    
+    // The serial path holds one expanded batch on top of the states
+    BudgetReport report;
+    subsetConstruct(nfa, SubsetBudget(), &report);
+    CHECK(report.ok && report.bytes > 0 && report.peakBytes > report.bytes);
+}
+
+// Each state has two successors, so a budget is overrun by at most two
+static void testBudgetStopsEarly() {
+    FullNFA nfa = blowupNFA(14);
+    SubsetBudget budget;
+    budget.maxStates = 100;
+    BudgetReport report;
+    auto dfa = subsetConstruct(nfa, budget, &report);
+    CHECK(dfa.empty() && !report.ok && report.exceeded == "states");
+    CHECK(report.states <= budget.maxStates + 2);
+
+    SubsetBudget memory;
+    memory.maxBytes = 64 * 1024;
+    report = BudgetReport();
+    subsetConstruct(nfa, memory, &report);
+    CHECK(!report.ok && report.exceeded == "memory");
+    CHECK(report.bytes < memory.maxBytes * 2);
+}
+
+// One rule built by `build`, accepted as token 1
+static FullNFA oneRule(const std::function<NFAFragment(FullNFA &)> &build) {
+    FullNFA nfa;
+    nfa.start = nfa.newState();
+    NFAFragment f = build(nfa);
+    nfa.states[nfa.start].trans.emplace_back(f.start, L_EPS, 0);
+    nfa.acceptToken[f.accept] = 1;
+    return nfa;
+}
+
+static bool rejected(const FullNFA &nfa) {
+    BudgetReport report;
+    auto dfa = subsetConstruct(nfa, SubsetBudget(), &report);
+    return dfa.empty() && !report.ok && report.exceeded.empty() && !report.error.empty();
+}
+
+static void testCounterBounds() {
+    auto a23 = oneRule([](FullNFA &n) { return countedFrag(n, L_CHAR, 'a', 2, 3); });
+    CHECK(checkCounters(a23));
+    auto dfa = subsetConstruct(a23);
+    CHECK(tokenize(dfa, "a").empty());
+    CHECK(tokenize(dfa, "aaa").size() == 2);
+    CHECK(tokenize(dfa, "aaaa").empty()); // aaa, then a lone a
+    CHECK(tokenize(dfa, "aaaaa").size() == 3); // aaa aa
+
+    const int bad[][2] = {{3, 2}, {0, 0}, {-1, 2}, {1, -4}};
+    for(const auto &b : bad) {
+        int min = b[0], max = b[1];
+        auto nfa = oneRule([&](FullNFA &n) { return countedFrag(n, L_CHAR, 'a', min, max); });
+        std::string error;
+        CHECK(!checkCounters(nfa, &error) && !error.empty());
+        CHECK(rejected(nfa));
+    }
+}
+
+static void testCounterShapes() {
+    // (a{1,2})*
+    auto starred = oneRule([](FullNFA &n) { return starFrag(n, countedFrag(n, L_CHAR, 'a', 1, 2)); });
+    CHECK(!checkCounters(starred));
+    CHECK(rejected(starred));
+
+    // (b a{1,2})* - the loop is reached again through other states
+    auto cycle = oneRule([](FullNFA &n) {
+        NFAFragment ba = concatFrag(n, makeAtomic(n, L_CHAR, 'b'), countedFrag(n, L_CHAR, 'a', 1, 2));
+        return starFrag(n, ba);
+    });
+    CHECK(rejected(cycle));
+
+    // a{1,3} a{1,3}: after "aa" both loops count
+    auto twice = oneRule([](FullNFA &n) {
+        return concatFrag(n, countedFrag(n, L_CHAR, 'a', 1, 3), countedFrag(n, L_CHAR, 'a', 1, 3));
+    });
+    CHECK(checkCounters(twice));
+    CHECK(rejected(twice));
+
+    // a{1,3} b{1,3} never counts both at once
+    auto disjoint = oneRule([](FullNFA &n) {
+        return concatFrag(n, countedFrag(n, L_CHAR, 'a', 1, 3), countedFrag(n, L_CHAR, 'b', 1, 3));
+    });
+    CHECK(!rejected(disjoint));
+}
+
+// An over-budget NFA is simulated, unless it has counted loops; either way
+// nothing is printed while the budget runs out
+static void testLexEngineFallback() {
+    SubsetBudget budget;
+    budget.maxStates = 2;
+
+    LexEngine plain;
+    CHECK(stdoutOf([&] { plain = buildLexEngine(buildCombinedNFA(), budget); }).empty());
+    CHECK(plain.usable() && plain.simulated());
+    auto exact = tokenize(subsetConstruct(buildCombinedNFA()), "x1 + 2.5");
+    CHECK(sameTokens(tokenize(plain, "x1 + 2.5"), exact));
+
+    auto a23 = oneRule([](FullNFA &n) { return countedFrag(n, L_CHAR, 'a', 2, 3); });
+    CHECK(tokenizeNFA(a23, "aaaa").empty());
+    LexEngine counted = buildLexEngine(a23, budget);
+    CHECK(!counted.usable() && !counted.simulated() && !counted.report.error.empty());
+    CHECK(tokenize(counted, "aaa").empty());
+
+    LexEngine fits = buildLexEngine(a23, SubsetBudget());
+    CHECK(fits.usable() && !fits.simulated());
+    CHECK(tokenize(fits, "aaa").size() == 2);
+}
+
+// Every scanning loop recovers from errors the same way
+static void testRecoveryAgrees() {
+    FullNFA nfa = buildCombinedNFA();
+    auto dfa = subsetConstruct(nfa);
+    RegexPool pool;
+    DerivativeDFA lazy(pool, buildCombinedRegex(pool));
+    LexOptions opts;
+    opts.recoverErrors = true;
+
+    std::mt19937 rng(38);
+    const std::string alphabet = "ab1.+( )?#";
+    for(int iter = 0; iter < 500; iter++) {
+        std::string in;
+        for(size_t i = rng() % 16; i > 0; i--) in += alphabet[rng() % alphabet.size()];
+
+        auto expected = tokenize(dfa, in, opts);
+        std::vector<Token> pulled;
+        for(LexCursor c(dfa, in, opts); c.valid(); c.next()) {
+            pulled.push_back({c.id(), c.lexeme(), c.pos()});
+        }
+        CHECK(sameTokens(tokenizeLazy(lazy, in, opts), expected));
+        CHECK(sameTokens(tokenizeNFA(nfa, in, opts), expected));
+        CHECK(sameTokens(pulled, expected));
+    }
+}
+
+static std::string readFile(const std::string &path) {
+    std::ifstream f(path, std::ios::binary);
+    std::ostringstream buf;
+    buf << f.rdbuf();
+    return buf.str();
+}
+
+static void writeFile(const std::string &path, const std::string &bytes) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(bytes.data(), bytes.size());
+}
+
+// Artifacts round-trip; a header whose sizes do not add up to the file,
+// even by wrapping around in 32 bits, is refused
+static void testCorruptArtifact() {
+    const std::string path = "automata_tests_grammar.ll1";
+    const CompiledGrammar &g = builtinGrammar();
+    CHECK(writeGrammarArtifact(path, g, 45));
+    CompiledGrammar loaded;
+    CHECK(loadGrammarArtifact(path, loaded, 45));
+    CHECK(loaded.symbolNames == g.symbolNames && loaded.table == g.table && loaded.prodRhs == g.prodRhs);
+    std::string good = readFile(path);
+
+    // Header fields: numSymbols, numTerminals, startSym, numProds, nameBytes, rhsTotal
+    for(size_t field = 16; field < 40; field += 4) {
+        for(uint32_t value : {0xFFFFFFFFu, 0xFFFFFFFEu, 0x40000000u, 0u}) {
+            std::string bad = good;
+            std::memcpy(&bad[field], &value, 4);
+            writeFile(path, bad);
+            CompiledGrammar out;
+            std::string error;
+            CHECK(!loadGrammarArtifact(path, out, 45, &error) && !error.empty());
+            CHECK(out.symbolNames.empty());
+        }
+    }
+
+    writeFile(path, good.substr(0, good.size() - 4));
+    CHECK(!loadGrammarArtifact(path, loaded));
+    writeFile(path, good.substr(0, 20));
+    CHECK(!loadGrammarArtifact(path, loaded));
+    std::remove(path.c_str());
+}
+
+// buildTree() mid-parse only applies from the next parse on
+template <class Session>
+static void checkTreeLatch() {
+    auto tokens = tokenize(subsetConstruct(buildCombinedNFA()), "a * (1 + b)");
+    TreeArena arena;
+    Session session;
+    session.begin(tokens);
+    for(int i = 0; i < 3; i++) session.step();
+    session.buildTree(&arena);
+    CHECK(session.run());
+    CHECK(arena.size() == 0 && session.treeRoot() == NO_NODE);
+
+    session.begin(tokens);
+    CHECK(session.run());
+    CHECK(arena.size() > 0 && session.treeRoot() != NO_NODE);
+    if(session.treeRoot() != NO_NODE) CHECK(arena[session.treeRoot()].len == 11);
+
+    session.buildTree(nullptr);
+    size_t built = arena.size();
+    session.begin(tokens);
+    CHECK(session.run());
+    CHECK(arena.size() == built);
+}
+
+static void testTreeLatch() {
+    checkTreeLatch<ParseSession>();
+    checkTreeLatch<LRSession>();
+}
+
+// Keyword ids can pass 255; the id column must neither truncate them nor
+// wrap ids past its range
+static void testWideTokenIds() {
+    TokenStream stream;
+    stream.push(300, 0, 2);
+    stream.push(TK_ID, 3, 1, 7);
+    stream.push(TokenStream::MAX_ID, 5, 4);
+    CHECK(stream.size() == 3);
+    CHECK(stream.id(0) == 300 && stream.idColumn()[0] == 300);
+    CHECK(stream.id(2) == TokenStream::MAX_ID);
+    auto tokens = stream.toTokens("if x then");
+    CHECK(tokens.size() == 3 && tokens[0].id == 300 && tokens[2].id == TokenStream::MAX_ID);
+    CHECK(stream.pos(2) == 5 && stream.length(2) == 4);
+    
+    // Out-of-range ids are refused, not truncated
+    CHECK(!stream.push(TokenStream::MAX_ID + 1, 10, 1) && !stream.push(-1, 10, 1));
+    CHECK(stream.size() == 3);
+    tokens.push_back({TokenStream::MAX_ID + 1, "x", 10, -1});
+    CHECK(TokenStream::fromTokens(tokens).empty());
+    
+    static constexpr Keyword narrow[] = {{"then", 300}};
+    static constexpr Keyword wide[] = {{"then", TokenStream::MAX_ID + 1}};
+    static constexpr auto narrowTable = makeKeywordTable(narrow);
+    static constexpr auto wideTable = makeKeywordTable(wide);
+    LexOptions opts;
+    opts.keywords = narrowTable.map();
+    TokenStream lexed = tokenizeStream(builtinLexer().dfa, "a then b", opts);
+    CHECK(lexed.size() == 4 && lexed.id(1) == 300);
+    opts.keywords = wideTable.map();
+    CHECK(tokenizeStream(builtinLexer().dfa, "a then b", opts).empty());
+}
+
+// LR tables intern the grammar but build no LL(1) table beside it
+static void testLALRSkipsLL1() {
+    const LRTable &t = builtinLRTable();
+    CHECK(t.grammar.table.empty());
+    CHECK(t.grammar.startSym >= t.grammar.numTerminals);
+    CHECK(t.grammar.prodRhs.size() == expressionGrammarLR().size());
+    CHECK(!builtinGrammar().table.empty());
+}
+
+// The shared lexer is built on first use, possibly on a server thread
+static void testBuiltinLexerQuiet() {
+    CHECK(stdoutOf([] { compileLexer(buildCombinedNFA(true)); }).empty());
+    CHECK(stdoutOf([] { builtinLexer(); }).empty());
+    CHECK(!builtinLexer().dfa.empty());
+}
+
+// Leftmost-longest occurrences by trying an anchored match at every offset
+static std::vector<Match> bruteFindAll(const std::vector<DFAState> &dfa, const std::string &in) {
+    std::vector<Match> out;
+    int n = in.size();
+    for(int pos = 0; pos < n;) {
+        int s = 0, last = -1, end = pos;
+        for(int i = pos; i < n; i++) {
+            auto it = dfa[s].trans.find(in[i]);
+            if(it == dfa[s].trans.end()) break;
+            s = it->second;
+            if(dfa[s].accept) {
+                last = s;
+                end = i + 1;
+            }
+        }
+        if(last < 0) {
+            pos++;
+            continue;
+        }
+        const auto &tks = dfa[last].tokens;
+        out.push_back({*std::min_element(tks.begin(), tks.end()), pos, end});
+        pos = end;
+    }
+    return out;
+}
+
+static void testFindAllRandom() {
+    std::vector<FullNFA> specs = {literalsNFA({"a", "aaab", "ab", "c", "b"}, {1, 2, 3, 4, 5}),
+                                  buildCombinedNFA()};
+    std::mt19937 rng(33);
+    for(const auto &nfa : specs) {
+        SearchDFA search;
+        CHECK(stdoutOf([&] { search = buildSearchDFA(nfa); }).empty());
+        auto forward = subsetConstruct(nfa);
+        
+        const std::string alphabet = "aabc 1x+.(";
+        for(int iter = 0; iter < 2000; iter++) {
+            std::string in;
+            int len = rng() % 24;
+            for(int i = 0; i < len; i++) in += alphabet[rng() % alphabet.size()];
+            
+            auto got = findAll(search, in);
+            auto want = bruteFindAll(forward, in);
+            bool same = got.size() == want.size();
+            for(size_t i = 0; same && i < got.size(); i++) {
+                same = got[i].token == want[i].token && got[i].start == want[i].start &&
+                       got[i].end == want[i].end;
+            }
+            CHECK(same);
+            if(!same) {
+                std::printf("  findAll mismatch on \"%s\"\n", in.c_str());
+                break;
+            }
+        }
+    }
+}
+
+// A counted loop in a later mode keeps its variant links inside that mode
+static void testModalCounters() {
+    LexerMode outer{"outer", literalsNFA({"x"}, {2}), {{2, {MODE_PUSH, 1}}}};
+    LexerMode inner{"inner", oneRule([](FullNFA &n) { return countedFrag(n, L_CHAR, 'a', 2, 3); }), {}};
+    ModalDFA modal;
+    CHECK(stdoutOf([&] { modal = buildModalDFA({outer, inner}); }).empty());
+    
+    int first = modal.start[1];
+    for(size_t i = first; i < modal.states.size(); i++) {
+        const DFACounter &ctr = modal.states[i].counter;
+        CHECK(ctr.belowMin == -1 || ctr.belowMin >= first);
+        CHECK(ctr.atMax == -1 || ctr.atMax >= first);
+    }
+    
+    auto tokens = tokenizeModal(modal, "xaaa");
+    CHECK(tokens.size() == 3 && tokens[0].id == 2 && tokens[1].id == 1 && tokens[1].lexeme == "aaa");
+}
+
+// TAG_NUMBER_INT_END sits after the integer digits, before any fraction
+static void testNumberTags() {
+    CHECK(Token().tags == unsetTags());
+    for(int t : unsetTags()) CHECK(t == -1);
+    
+    auto tokens = tokenize(builtinLexer(), "12.5 + x * 7 + 300");
+    CHECK(tokens.size() == 8);
+    if(tokens.size() != 8) return;
+    CHECK(tokens[0].id == TK_NUMBER && tokens[0].tags[TAG_NUMBER_INT_END] == 2);
+    CHECK(tokens[1].tags[TAG_NUMBER_INT_END] == -1);
+    CHECK(tokens[2].id == TK_ID && tokens[2].tags[TAG_NUMBER_INT_END] == -1);
+    CHECK(tokens[4].id == TK_NUMBER && tokens[4].tags[TAG_NUMBER_INT_END] == 12);
+    CHECK(tokens[6].id == TK_NUMBER && tokens[6].tags[TAG_NUMBER_INT_END] == 18);
+    
+    // Reused tokens after an edit shift their tags with their positions
+    std::string before = "12.5 + x * 7 + 300", after = "0 + 12.5 + x * 7 + 300";
+    auto redone = retokenize(builtinLexer().dfa, tokens, after, diffText(before, after));
+    CHECK(redone.size() == 10);
+    if(redone.size() == 10) {
+        CHECK(redone[2].tags[TAG_NUMBER_INT_END] == 6);
+        CHECK(redone[8].tags[TAG_NUMBER_INT_END] == 22);
+    }
+}
+
+static bool sameTree(const TreeArena &a, const TreeArena &b) {
+    if(a.size() != b.size()) return false;
+    for(uint32_t i = 0; i < a.size(); i++) {
+        if(a[i].symbol != b[i].symbol || a[i].firstChild != b[i].firstChild ||
+           a[i].nextSibling != b[i].nextSibling || a[i].pos != b[i].pos || a[i].len != b[i].len) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Lexing and parsing in one pass through LexCursor gives the same tokens,
+// verdict and tree as tokenizing first
+static void testLexCursorParse() {
+    const CompiledLexer &lexer = builtinLexer();
+    std::mt19937 rng(50);
+    const std::string alphabet = "ab1 +-*/()(";
+    Parser pulled, stored;
+    TreeArena pulledTree, storedTree;
+    pulled.buildTree(&pulledTree);
+    stored.buildTree(&storedTree);
+    int accepted = 0;
+    
+    for(int iter = 0; iter < 3000; iter++) {
+        std::string in;
+        int len = 1 + rng() % 16;
+        for(int i = 0; i < len; i++) in += alphabet[rng() % alphabet.size()];
+        if(iter % 100 == 0) in += '#'; // Lexical error
+        auto tokens = tokenize(lexer, in);
+        
+        std::vector<Token> walked;
+        for(LexCursor c(lexer, in); c.valid(); c.next()) walked.push_back({c.id(), c.lexeme(), c.pos()});
+        LexCursor check(lexer, in);
+        while(check.valid()) check.next();
+        CHECK(check.failed() ? tokens.empty() : sameTokens(walked, tokens));
+        
+        pulledTree.reset();
+        storedTree.reset();
+        pulled.reset();
+        stored.reset();
+        LexCursor cursor(lexer, in);
+        bool ok = pulled.parseAll(cursor);
+        bool want = stored.parseAll(tokens);
+        CHECK(ok == want);
+        if(ok && want) {
+            CHECK(pulled.treeRoot() == stored.treeRoot() && sameTree(pulledTree, storedTree));
+            accepted++;
+        }
+    }
+    CHECK(accepted > 100);
+}
+
+static int keywordOf(const KeywordMap &map, const std::string &s) {
+    return map.lookup(s.data(), s.size(), SymbolTable::hash(s.data(), s.size()));
+}
+
+// Every keyword finds itself in the perfect hash; nothing else does
+static void testKeywordTable() {
+    static constexpr Keyword words[] = {
+        {"if", 20}, {"then", 21}, {"else", 22}, {"while", 23}, {"for", 24}, {"return", 25},
+        {"let", 26}, {"in", 27}, {"fn", 28}, {"true", 29}, {"false", 30}, {"and", 31},
+        {"or", 32}, {"not", 33}};
+    static constexpr auto table = makeKeywordTable(words);
+    static_assert(table.map().size == 14, "built at compile time");
+    KeywordMap map = table.map();
+    
+    for(const auto &w : words) CHECK(keywordOf(map, w.name) == w.token);
+    
+    const char *nearMisses[] = {"", "i", "iff", "If", "thenx", "the", "elsa", "whilee", "fo",
+                                "retur", "lett", "inn", "nf", "True", "falsey", "an", "o", "note"};
+    for(const char *s : nearMisses) CHECK(keywordOf(map, s) == -1);
+    
+    static constexpr Keyword one[] = {{"if", 40}};
+    static constexpr auto single = makeKeywordTable(one);
+    CHECK(keywordOf(single.map(), "if") == 40 && keywordOf(single.map(), "it") == -1);
+    
+    // Reclassified while lexing, without touching identifiers
+    LexOptions opts;
+    opts.keywords = map;
+    auto tokens = tokenize(builtinLexer(), "if x then iff", opts);
+    CHECK(tokens.size() == 5);
+    if(tokens.size() == 5) {
+        CHECK(tokens[0].id == 20 && tokens[1].id == TK_ID && tokens[2].id == 21 && tokens[3].id == TK_ID);
+    }
+}
+
+// Same states (by NFA set), accepts and transitions, whatever the numbering
+static bool sameDFA(const std::vector<DFAState> &a, const std::vector<DFAState> &b) {
+    if(a.size() != b.size()) return false;
+    std::map<std::set<int>, const DFAState *> byStates;
+    for(const auto &st : b) byStates[st.nfaStates] = &st;
+    for(const auto &st : a) {
+        auto it = byStates.find(st.nfaStates);
+        if(it == byStates.end()) return false;
+        const DFAState &other = *it->second;
+        std::set<int> tokens(st.tokens.begin(), st.tokens.end());
+        if(st.accept != other.accept || tokens != std::set<int>(other.tokens.begin(), other.tokens.end()) ||
+           st.trans.size() != other.trans.size()) {
+            return false;
+        }
+        for(const auto &t : st.trans) {
+            auto o = other.trans.find(t.first);
+            if(o == other.trans.end() || a[t.second].nfaStates != b[o->second].nfaStates) return false;
+        }
+    }
+    return a[0].nfaStates == b[0].nfaStates;
+}
+
+static NFAFragment literalFrag(FullNFA &nfa, const std::string &word) {
+    NFAFragment f = makeAtomic(nfa, L_CHAR, word[0]);
+    for(size_t i = 1; i < word.size(); i++) f = concatFrag(nfa, f, makeAtomic(nfa, L_CHAR, word[i]));
+    return f;
+}
+
+// Random rule additions and removals keep the DFA equal to a fresh build
+static void testIncrementalMatchesFresh() {
+    IncrementalDFA inc(buildCombinedNFA());
+    CHECK(inc.valid());
+    std::mt19937 rng(37);
+    std::vector<int> live;
+    const std::string alphabet = "abif1";
+    
+    for(int iter = 0; iter < 60; iter++) {
+        if(live.empty() || rng() % 3 != 0) {
+            std::string word;
+            int len = 1 + rng() % 4;
+            for(int i = 0; i < len; i++) word += alphabet[rng() % alphabet.size()];
+            int rule = inc.addRule([&](FullNFA &n) { return literalFrag(n, word); }, 20 + iter);
+            CHECK(rule >= 0);
+            live.push_back(rule);
+        } else {
+            size_t k = rng() % live.size();
+            inc.removeRule(live[k]);
+            live.erase(live.begin() + k);
+        }
+        
+        auto fresh = subsetConstruct(inc.nfa());
+        bool same = sameDFA(inc.dfa(), fresh);
+        CHECK(same);
+        if(!same) {
+            std::printf("  incremental DFA diverged at step %d\n", iter);
+            break;
+        }
+        CHECK(sameTokens(tokenize(inc.dfa(), "if a1 + bi * 11.5 (fa)"),
+                         tokenize(fresh, "if a1 + bi * 11.5 (fa)")));
+    }
+    
+    auto a23 = [](FullNFA &n) { return countedFrag(n, L_CHAR, 'a', 2, 3); };
+    size_t states = inc.dfa().size();
+    CHECK(inc.addRule(a23, 99) == -1 && inc.dfa().size() == states);
+}
+
+static std::string encodeUtf8(uint32_t cp) {
+    std::string out;
+    if(cp < 0x80) {
+        out += (char)cp;
+    } else if(cp < 0x800) {
+        out += (char)(0xC0 | cp >> 6);
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if(cp < 0x10000) {
+        out += (char)(0xE0 | cp >> 12);
+        out += (char)(0x80 | (cp >> 6 & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | cp >> 18);
+        out += (char)(0x80 | (cp >> 12 & 0x3F));
+        out += (char)(0x80 | (cp >> 6 & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+static bool matchesSequence(const std::vector<std::vector<ByteRange>> &seqs, const std::string &bytes) {
+    for(const auto &seq : seqs) {
+        if(seq.size() != bytes.size()) continue;
+        bool ok = true;
+        for(size_t i = 0; i < seq.size() && ok; i++) {
+            unsigned char b = bytes[i];
+            ok = b >= seq[i].lo && b <= seq[i].hi;
+        }
+        if(ok) return true;
+    }
+    return false;
+}
+
+// A code point's encoding matches a sequence exactly when it is in range
+// and not a surrogate; ranges straddle every encoding-length boundary
+static void testUtf8Sequences() {
+    const uint32_t ranges[][2] = {{0, 0x7F},         {0x41, 0x5A},       {0x70, 0x90},
+                                  {0x7F0, 0x850},    {0xD000, 0xE100},   {0xD800, 0xDFFF},
+                                  {0xFFF0, 0x10010}, {0x3040, 0x30FF},   {0x10FFF0, 0x10FFFF},
+                                  {0, 0x10FFFF}};
+    std::mt19937 rng(40);
+    for(const auto &r : ranges) {
+        auto seqs = utf8Sequences(r[0], r[1]);
+        std::vector<uint32_t> probes;
+        for(uint32_t d = 0; d < 300; d++) {
+            if(r[0] >= d) probes.push_back(r[0] - d);
+            if(r[1] + d <= 0x10FFFF) probes.push_back(r[1] + d);
+        }
+        for(int i = 0; i < 3000; i++) probes.push_back(rng() % 0x110000);
+        for(uint32_t cp : probes) {
+            bool want = cp >= r[0] && cp <= r[1] && (cp < 0xD800 || cp > 0xDFFF);
+            if(cp >= 0xD800 && cp <= 0xDFFF) continue; // Not encodable
+            CHECK(matchesSequence(seqs, encodeUtf8(cp)) == want);
+        }
+    }
+}
+
+// Identifiers may use any XID_Start / XID_Continue letters
+static void testUnicodeIdentifiers() {
+    const CompiledLexer &lexer = builtinLexer();
+    auto tokens = tokenize(lexer, "héllo + Δx * 名前1 - 1名");
+    const char *lexemes[] = {"héllo", "+", "Δx", "*", "名前1", "-", "1", "名"};
+    const int ids[] = {TK_ID, TK_PLUS, TK_ID, TK_STAR, TK_ID, TK_MINUS, TK_NUMBER, TK_ID};
+    CHECK(tokens.size() == 9);
+    for(size_t i = 0; i < 8 && i < tokens.size(); i++) {
+        CHECK(tokens[i].id == ids[i] && tokens[i].lexeme == lexemes[i]);
+    }
+    
+    CHECK(tokenize(lexer, "x€").empty());  // U+20AC is not XID_Continue
+    CHECK(tokenize(lexer, "\xC3(").empty()); // Truncated sequence
+    CHECK(tokenize(subsetConstruct(buildCombinedNFA()), "héllo").empty()); // ASCII spec
+}
+
+// The generated table is the one fillGrammar() used to write by hand
+static void testLL1Table() {
+    const CompiledGrammar &g = builtinGrammar();
+    std::map<std::pair<std::string, std::string>, int> expected;
+    for(std::string t : {"+", "-", "(", "ID", "NUMBER"}) {
+        expected[{"E", t}] = 0;
+        expected[{"T", t}] = 4;
+    }
+    expected[{"E'", "+"}] = 1;
+    expected[{"E'", "-"}] = 2;
+    expected[{"E'", ")"}] = 3;
+    expected[{"E'", "$"}] = 3;
+    expected[{"T'", "*"}] = 5;
+    expected[{"T'", "/"}] = 6;
+    for(std::string t : {"+", "-", "$", ")"}) expected[{"T'", t}] = 7;
+    expected[{"F", "+"}] = 8;
+    expected[{"F", "-"}] = 9;
+    expected[{"F", "("}] = 10;
+    expected[{"F", "ID"}] = 11;
+    expected[{"F", "NUMBER"}] = 12;
+    
+    CHECK(g.numTerminals == 9);
+    for(size_t a = g.numTerminals; a < g.symbolNames.size(); a++) {
+        for(int t = 0; t < g.numTerminals; t++) {
+            auto it = expected.find({g.symbolNames[a], g.symbolNames[t]});
+            CHECK(g.predict(a, t) == (it == expected.end() ? -1 : it->second));
+        }
+    }
+}
+
+// S -> A x | B x with A -> a, B -> a needs two tokens of lookahead
+static void testLL1Conflict() {
+    const std::string text = "S -> A x | B x\nA -> a\nB -> a\n";
+    std::vector<Production> prods;
+    std::string start;
+    CHECK(parseGrammarText(text, prods, start));
+    std::vector<LL1Conflict> conflicts;
+    CompiledGrammar g = compileGrammar(prods, start, &conflicts);
+    CHECK(conflicts.size() == 1);
+    if(conflicts.size() == 1) {
+        CHECK(conflicts[0].nonterminal == "S" && conflicts[0].terminal == "a");
+        CHECK(conflicts[0].first == 0 && conflicts[0].second == 1);
+        CHECK(describeConflict(g, conflicts[0]) == "S on a: S -> A x and S -> B x both apply");
+    }
+    
+    const std::string path = "automata_tests_conflict.grammar";
+    writeFile(path, text);
+    CompiledGrammar out = builtinGrammar();
+    std::string error;
+    conflicts.clear();
+    CHECK(!loadGrammarFile(path, ".", out, &conflicts, &error));
+    CHECK(conflicts.size() == 1 && out.table == builtinGrammar().table);
+    CHECK(error.find("not LL(1): S on a: S -> A x and S -> B x") != std::string::npos);
+    std::remove(path.c_str());
+}
+
+// The three expression engines accept and reject the same inputs
+static void testExpressionEnginesAgree() {
+    const char *pieces[] = {"a", "1", "+", "-", "*", "/", "(", ")", "b", "2.5"};
+    std::mt19937 rng(48);
+    ParseSession ll;
+    LRSession lr;
+    PrattParser pratt;
+    int accepted = 0;
+    
+    for(int iter = 0; iter < 5000; iter++) {
+        std::string in;
+        int len = 1 + rng() % 12;
+        for(int i = 0; i < len; i++) in += std::string(pieces[rng() % 10]) + " ";
+        auto tokens = tokenize(builtinLexer(), in);
+        TokenStream stream = TokenStream::fromTokens(tokens);
+        
+        ll.begin(tokens);
+        bool llOk = ll.run();
+        lr.begin(tokens);
+        bool lrOk = lr.run();
+        bool prattOk = pratt.parse(tokens);
+        CHECK(llOk == lrOk && llOk == prattOk);
+        CHECK(pratt.parse(stream) == prattOk);
+        if(llOk != lrOk || llOk != prattOk) {
+            std::printf("  engines disagree on \"%s\"\n", in.c_str());
+            break;
+        }
+        accepted += llOk;
+    }
+    CHECK(accepted > 200);
+}
+
+// Interning is a dense, stable round trip, through growth and through
+// names whose hashes all collide
+static void testSymbolTable() {
+    SymbolTable table;
+    const int n = 20000;
+    for(int i = 0; i < n; i++) CHECK(table.intern("sym" + std::to_string(i)) == i);
+    CHECK(table.size() == (size_t)n);
+    bool roundTrip = true;
+    for(int i = 0; i < n; i++) {
+        std::string name = "sym" + std::to_string(i);
+        roundTrip &= table.intern(name) == i && table.find(name) == i && table.name(i) == name;
+    }
+    CHECK(roundTrip && table.size() == (size_t)n);
+    CHECK(table.find("sym") == -1 && table.find("sym20000") == -1);
+    
+    // Every name in one probe chain, including prefixes of each other
+    SymbolTable colliding;
+    std::vector<std::string> names = {"", "a", "aa", "aaa", "ab", "b"};
+    for(int i = 0; i < 500; i++) names.push_back("c" + std::to_string(i));
+    for(size_t i = 0; i < names.size(); i++) {
+        CHECK(colliding.intern(names[i].data(), names[i].size(), 7) == (int)i);
+    }
+    for(size_t i = 0; i < names.size(); i++) {
+        CHECK(colliding.find(names[i].data(), names[i].size(), 7) == (int)i);
+        CHECK(colliding.intern(names[i].data(), names[i].size(), 7) == (int)i);
+        CHECK(colliding.name(i) == names[i]);
+    }
+    CHECK(colliding.find("aaaa", 4, 7) == -1 && colliding.find("a", 1, 8) == -1);
+    
+    colliding.clear();
+    CHECK(colliding.size() == 0 && colliding.find("a", 1, 7) == -1);
+    CHECK(colliding.intern("z") == 0);
+}
+
+int main() {
+    testRetokenizeLookahead();
+    testRetokenizeRandom();
+    testParallelMatchesSerial();
+    testBudgetStopsEarly();
+    testCounterBounds();
+    testCounterShapes();
+    testLexEngineFallback();
+    testRecoveryAgrees();
+    testCorruptArtifact();
+    testTreeLatch();
+    testWideTokenIds();
+    testLALRSkipsLL1();
+    testBuiltinLexerQuiet();
+    testFindAllRandom();
+    testModalCounters();
+    testNumberTags();
+    testLexCursorParse();
+    testKeywordTable();
+    testIncrementalMatchesFresh();
+    testUtf8Sequences();
+    testUnicodeIdentifiers();
+    testLL1Table();
+    testLL1Conflict();
+    testExpressionEnginesAgree();
+    testSymbolTable();
+
+    if(failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("all tests passed\n");
+    return 0;
+}